@@ -1,4 +1,12 @@
 ﻿#include <string>
+#include <vector>
+
+#include "include/table_model.h"
+#include "include/stop_token.h"
+#include "include/text_crops.h"
+
+// 通用文字识别(标准含位置版)接口, 与表格识别使用同一个 Access Token
+const std::string BD_GENERAL_OCR_URL = "https://aip.baidubce.com/rest/2.0/ocr/v1/general";
 
 /**
  * 用以获取access_token的函数，使用时需要先在百度云控制台申请相应功能的应用，获得对应的API Key和Secret Key
@@ -20,17 +28,46 @@ static size_t bdGetResponse(void *ptr, size_t size, size_t nmemb, void *stream);
 
 /**
 * 表格文字识别(异步接口)
+* @param token 请求停止时中止传输
 * @return 调用成功返回0，发生错误返回其他错误码
 */
 int bdFormOcrRequest(std::string &json_result,
     const std::string &request_url,
-    const std::string &base64_image, const std::string &access_token);
+    const std::string &base64_image, const std::string &access_token,
+    const StopToken &token = StopToken());
 
 /*
 * @brief 获取表格识别结果
 * @param json_result 获取到的返回值, json 格式字符串
+* @param token 请求停止时中止传输
 * @return 成功返回0，否则返回其他错误码
 */
 int bdGetResult(std::string &json_result, const std::string &request_url,
     const std::string &access_token, const std::string &request_id,
-    const std::string &result_type);
+    const std::string &result_type, const StopToken &token = StopToken());
+
+/*
+* @brief 流式解析表格识别请求接口的返回数据, 取出 result[0].request_id
+* @param error 失败时的错误信息
+* @return 成功返回true, 数据格式错误或接口返回错误时返回false
+*/
+bool bdParseRequestId(const std::string &str, std::string &request_id, std::string &error);
+
+/*
+* @brief 流式解析百度表格识别的返回数据, 不构建 json 对象, 第一个表格的单元格
+*  直接写入 model
+* @param str 获取结果接口返回的json格式字符串
+* @param model 识别结果, 没有识别到表格时为空
+* @param error 失败时的错误信息
+* @param ret_code 不为空时写入任务状态 result.ret_code(3 为已完成), 数据中没有时为-1
+* @return 成功返回true, 任务未完成、数据格式错误或接口返回错误时返回false
+*/
+bool bdParseTable(const std::string &str, TableModel &model, std::string &error,
+    int *ret_code = nullptr);
+
+/*
+* @brief 流式解析百度通用文字识别的返回数据, 得到各文本行及其位置.
+*  请求与表格识别相同, 以 BD_GENERAL_OCR_URL 调用 bdFormOcrRequest 即可
+* @return 成功返回true, 数据格式错误或接口返回错误时返回false
+*/
+bool bdParseText(const std::string &str, std::vector<TextLine> &lines, std::string &error);
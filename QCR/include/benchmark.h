@@ -0,0 +1,50 @@
+﻿/*
+* 基准测试入口, 通过命令行参数启动, 不创建界面:
+* QCR.exe --bench <name> [args...]
+*
+* 目前支持的测试:
+* morphology [图片目录...] [--repeat 5]
+*     线形形态学运算与 cv::erode/cv::dilate 的对比
+* contour [图片目录...] [--repeat 3] [--len 1000]
+*     轮廓识别各阶段耗时及顶点精度. 图片 xxx.jpg 的标注文件为同目录下的
+*     xxx.quad.json, 内容为 {"corners": [[x, y], ...]}, 依次为原图中左上、
+*     右上、右下、左下四个顶点的像素坐标; 没有标注文件的图片只统计耗时.
+*     平均误差只统计检测到的图片, 有标注但未检测到的图片数量单独给出.
+* fusion [--rows 200] [--cols 20] [--tables 10] [--repeat 5]
+*     在随机生成的合成表格上, 比较逐行扫描与列索引定位数字所在单元格的耗时,
+*     并检查两者结果是否一致.
+* celltext [--cells 20000] [--repeat 5]
+*     单元格文本分类与清洗, 正则表达式与查找表实现的单个单元格耗时对比.
+* grid [--rows 60] [--cols 30] [--repeat 5]
+*     在合成的表格线交点上, 比较改进前后 formatPointMatrix 的耗时及结果,
+*     规模从指定尺寸的 1/4 到 2 倍.
+* pipeline [图片目录...] [--fixtures test/fixtures] [--repeat 3] [--threads N] [--passes 2]
+*     对每张图片执行完整流程(解码、轮廓、校正、表格结构、去边框、分数列、数字识别、
+*     拼接、融合), 统计各阶段及端到端耗时, 以及 1 到 N 个线程同时处理时的吞吐量和
+*     进程峰值内存. 表格结构使用 fixtures 目录下录制的识别服务返回数据, 图片 xxx.jpg
+*     对应 xxx.tx.json 或 xxx.bd.json, 应为对轮廓识别并校正后的图片的识别结果;
+*     没有录制数据的图片使用本地识别的表格结构, 不需要网络. 录制时设置环境变量
+*     QCR_RECORD_FIXTURES=test/fixtures 后运行程序, 打开图片校正并用腾讯或百度识别,
+*     返回数据即按上述文件名写入该目录.
+* eval [图片目录...] [--truth test/truth] [--fixtures test/fixtures]
+*      [--min-height 12] [--max-height 80] [--min-width 6] [--max-width 60] [--splice-ratio 3]
+*     数字识别效果评估. 图片 xxx.jpg 的标注为 truth 目录下的 xxx.csv, 行列与表格识别结果
+*     一致. 统计分数列中识别服务结果与融合结果的单元格准确率、每秒识别的字符数以及逐位的
+*     混淆矩阵. 各阈值可以用逗号分隔给出多个值, 对所有组合分别评估.
+*
+* 需要图片的测试, 图片目录默认为 test, 可以指定多个. 结果以 json 格式写入 --out 指定的文件
+* (默认为 bench_<name>.json) 并打印到日志.
+*/
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+/*
+* @brief 运行指定的基准测试
+* @param argc 参数个数, 不包括 "--bench" 本身
+* @param argv 参数列表, argv[0] 为测试名称
+* @return 成功返回0, 否则返回非0
+*/
+int runBenchmark(int argc, char *argv[]);
+
+#endif // BENCHMARK_H
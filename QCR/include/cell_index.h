@@ -0,0 +1,37 @@
+﻿#ifndef CELL_INDEX_H
+#define CELL_INDEX_H
+
+#include <vector>
+
+#include "include/table_model.h"
+
+/*
+* 按列组织的单元格行带索引, 用于将识别出的数字归入所在的单元格.
+* 对每一列, 按行号顺序记录覆盖该列的单元格(即该行中左上角不在该列右侧的
+* 最近一个单元格), 以及单元格上下边界的前缀最大值. 前缀最大值单调不减,
+* 因此可以二分查找, 单次查询 O(log rows), 结果与逐行扫描完全一致.
+*/
+class CellIndex
+{
+public:
+    explicit CellIndex(const TableModel &model);
+
+    /*
+    * @brief 查找第 col 列中数字所在的单元格
+    * @param top, bottom 数字的上下边界
+    * @return 按行号顺序第一个下边界越过数字中线的单元格, 若在此之前已经出现
+    *         上边界低于数字底部的单元格, 或不存在这样的单元格, 返回 TableModel::npos
+    */
+    int locate(int col, int top, int bottom) const;
+
+private:
+    struct Band
+    {
+        int cell;
+        int max_top;     // 该列前缀的单元格上边界最大值
+        int max_bottom;  // 该列前缀的单元格下边界最大值
+    };
+    std::vector<std::vector<Band>> columns_;
+};
+
+#endif // CELL_INDEX_H
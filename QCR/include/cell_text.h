@@ -0,0 +1,30 @@
+﻿#ifndef CELL_TEXT_H
+#define CELL_TEXT_H
+
+#include <string>
+#include <string_view>
+
+// 单元格文本的特征
+struct CellTextInfo
+{
+    bool has_zh = false;      // 包含汉字 [一-龥]
+    bool has_en = false;      // 包含英文字母
+    bool has_num = false;     // 包含数字
+    bool has_score_char = false;  // 包含"平"、"时"、"成"、"绩"任意一个字
+    bool has_score_word = false;  // 包含"平时"或"成绩"
+    int length = 0;           // 字符数, 与 QString::size() 一致(UTF-16 编码单元数)
+};
+
+/*
+* @brief 一次扫描 UTF-8 文本得到各项特征, 使用查找表判断字符类别, 不使用正则表达式
+* @param text UTF-8 文本
+* @param clean 不为空时写入只保留中英文和数字的文本
+*/
+CellTextInfo classifyCellText(std::string_view text, std::string *clean = nullptr);
+
+/*
+* @brief 去除单元格文本中除中英文和数字以外的字符
+*/
+std::string cleanCellText(std::string_view text);
+
+#endif // CELL_TEXT_H
@@ -0,0 +1,61 @@
+﻿#ifndef COLUMN_STATS_H
+#define COLUMN_STATS_H
+
+#include <vector>
+
+#include "include/table_model.h"
+
+// 一组数值的稳健统计量
+struct RobustStats
+{
+    int count = 0;
+    double median = 0;
+    double mad = 0;           // 中位数绝对偏差, 已乘以1.4826, 与正态分布的标准差可比
+    double trimmed_mean = 0;  // 去掉两端各 trim 比例后的平均值
+};
+
+/*
+* @brief 计算稳健统计量, 会打乱 values 的顺序
+* @param values 数值, 作为计算时的缓冲区
+* @param trim 截尾均值两端各去掉的比例, 范围[0, 0.5)
+*/
+RobustStats robustStats(std::vector<int> &values, double trim = 0.1);
+
+/*
+* 一列单元格外接矩形的统计. 四条边分别连续存放, 计算时使用内部缓冲区,
+* 不复制输入; 同一个对象可以对多列重复使用, 不会重复分配内存.
+*/
+class ColumnStats
+{
+public:
+    enum Edge
+    {
+        LEFT,
+        TOP,
+        RIGHT,
+        BOTTOM,
+    };
+
+    void clear();
+    void add(int left, int top, int right, int bottom);
+    void add(const CellRect &rc) { add(rc.left, rc.top, rc.right, rc.bottom); }
+    int size() const { return static_cast<int>(edges_[LEFT].size()); }
+    bool empty() const { return edges_[LEFT].empty(); }
+
+    RobustStats stats(Edge edge, double trim = 0.1) const;
+
+    /*
+    * @brief 剔除某条边偏离中位数过大的单元格后, 剩余单元格的像素范围
+    * @param edge 用于判断离群的边
+    * @param k 偏离超过 k 倍 MAD 视为离群
+    * @param min_tol 最小容差(像素), 避免多数单元格完全对齐时 MAD 为0而剔除过多
+    * @return 剩余单元格的外接范围, 没有单元格时各边为0
+    */
+    CellRect inlierRange(Edge edge, double k = 3.0, double min_tol = 5.0) const;
+
+private:
+    std::vector<int> edges_[4];
+    mutable std::vector<int> scratch_;
+};
+
+#endif // COLUMN_STATS_H
@@ -14,6 +14,8 @@ const std::string CFG_NORMAL_IMG_LENGTH = "img_length";
 const std::string CFG_NORMAL_IMG_SIZE = "img_size";
 const std::string CFG_NORMAL_AUTO_EDGE_DETECTION = "auto_edge_detection";
 const std::string CFG_NORMAL_AUTO_OPTIMIZE = "auto_optimize";
+const std::string CFG_NORMAL_USE_TEMPLATE = "use_template";
+const std::string CFG_NORMAL_PDF_DPI = "pdf_dpi";
 
 const std::string CFG_SECTION_TX = "tx";
 const std::string CFG_TX_URL = "url";
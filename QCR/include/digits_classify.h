@@ -1,16 +1,49 @@
 ﻿#include <opencv2/core/mat.hpp>
 
+#include <vector>
+
+// 标准化后的数字图片边长, 与 MNIST 一致
+constexpr int DIGIT_SIDE = 28;
+// 单张标准化图片的像素数
+constexpr int DIGIT_PIXELS = DIGIT_SIDE * DIGIT_SIDE;
+// 字符倾斜角度(相对竖直方向)超过该值才进行校正, 单位: 度
+constexpr double DESKEW_ANGLE = 10.0;
+
 /*
 * @brief 加载模型
 * @param file_name 数字分类模型文件名"xxx.json"
 */
 void loadModel(const std::string &file_name);
 
+// 字符的水平剪切参数, 由 getShear 计算, skew 为0表示无需校正
+struct Shear
+{
+    double skew = 0.0;  // 剪切系数, 即字符主方向相对竖直方向倾角的正切值
+    double cy = 0.0;    // 剪切基准行, 即字符质心的纵坐标
+};
+
+/*
+* @brief 根据二阶中心矩估计标记图中某个字符的倾斜程度
+* @param labels connectedComponents 输出的 CV_32S 标记图(可以是 ROI)
+* @param label 字符对应的标记值
+* @return 倾角超过 DESKEW_ANGLE 时返回对应的剪切参数, 否则 skew 为0
+*/
+Shear getShear(const cv::Mat &labels, int label);
+
 /*
-* @brief 将cv::Mat的图片处理为标准的28×28像素
-* @param img 将img缩放至最长边28像素, 再补全边框使其成为标准的28×28的灰度图
+* @brief 将标记图中的一个字符直接映射到 28×28 的浮点张量位置, 一次完成剪切校正、
+*  缩放至最长边24像素、居中补边以及归一化到[0, 1], 不产生任何中间图片
+* @param labels connectedComponents 输出的 CV_32S 标记图(可以是 ROI)
+* @param label 字符对应的标记值, 属于该字符的像素为1, 其余为0
+* @param shear 剪切参数
+* @param dst 张量中该字符的起始地址, 需有 DIGIT_PIXELS 个 float 的空间
 */
-void stdProcImg(cv::Mat &img);
+void stdProcLabel(const cv::Mat &labels, int label, const Shear &shear, float *dst);
+
+/*
+* @brief 将8位灰度或BGR图片标准化后写入 28×28 的浮点张量位置, 处理方式同 stdProcLabel
+*/
+void stdProcImg(const cv::Mat &img, float *dst);
 
 /*
 * @brief 识别传入的图像并返回识别出的数字
@@ -19,3 +52,10 @@ void stdProcImg(cv::Mat &img);
 */
 int predict(const cv::Mat &src);
 
+/*
+* @brief 批量识别已标准化的图片
+* @param batch 连续存放的 count 张 28×28 已归一化的图片
+* @param count 图片数量
+* @return 按顺序返回每张图片识别到的数字
+*/
+std::vector<int> predictBatch(const float *batch, size_t count);
@@ -0,0 +1,30 @@
+﻿/*
+* 多页文档(PDF、多页 TIFF)的逐页读取. 每次调用独立打开文件并只解码请求的一页,
+* 因此可以在多个工作线程中同时读取同一文件的不同页, 整个文件不会一次性解码到内存中.
+*/
+
+#ifndef DOCUMENT_READER_H
+#define DOCUMENT_READER_H
+
+#include <QString>
+
+#include <opencv2/core.hpp>
+
+// 是否按多页文档打开(PDF 及 TIFF), 其他格式按单张图片打开
+bool isDocument(const QString &path);
+
+/*
+* @brief 读取文档的页数, 不解码页面内容
+* @return 无法打开时返回0
+*/
+int documentPageCount(const QString &path);
+
+/*
+* @brief 将文档的一页转换为 BGR 图片. PDF 按 dpi 渲染, 宽高超过 len 像素时直接以缩小后的尺寸渲染;
+*  TIFF 读取后按比例缩小到 len 像素以内. 不会修改原文件
+* @param page 页码, 从0开始
+* @return 读取失败时返回空图片
+*/
+cv::Mat readDocumentPage(const QString &path, int page, int dpi, int len);
+
+#endif  // DOCUMENT_READER_H
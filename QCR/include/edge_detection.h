@@ -0,0 +1,39 @@
+﻿#ifndef EDGE_DETECTION_H
+#define EDGE_DETECTION_H
+
+#include <opencv2/core.hpp>
+
+#include <vector>
+
+/*
+* @brief 合并霍夫变换检测的线段并计算四个交点坐标
+* @param lines 检测到的线段
+* @param points 四个交点坐标, 分别是[left-up, right-up, right-bottom, left-bottom]
+*/
+void getVertexes(std::vector<cv::Vec4i> &lines, std::vector<cv::Point> &points);
+
+// 轮廓识别各阶段的耗时(ms), 用于基准测试
+struct ContourTimings
+{
+    double resize = 0;     // 缩小图片及灰度化
+    double bilateral = 0;  // 双边滤波
+    double canny = 0;      // Otsu 阈值及 Canny 边缘检测
+    double contours = 0;   // 查找轮廓、最大轮廓的凸包及折线化
+    double hough = 0;      // 霍夫变换检测线段
+    double vertex = 0;     // 合并线段并计算顶点
+    double total = 0;
+};
+
+/*
+* @brief 检测图片中表格的四个顶点, 不访问界面, 可在工作线程中调用.
+*  边缘检测主要是拿到4个顶点的相对坐标, 内部会将图片缩小以加快处理速度
+* @param src 待检测的图片
+* @param points_rel 四个顶点相对于图片宽高的坐标, 依次为左上、右上、右下、左下
+* @param len 检测前将图片缩小到宽高不超过 len 像素
+* @param timings 不为空时记录各阶段耗时
+* @return 检测成功返回true
+*/
+bool detectContour(const cv::Mat &src, std::vector<std::vector<double>> &points_rel,
+    int len = 1000, ContourTimings *timings = nullptr);
+
+#endif // EDGE_DETECTION_H
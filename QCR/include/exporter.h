@@ -0,0 +1,73 @@
+﻿/*
+* 识别结果导出, 直接从 TableModel 写出, 输出经过缓冲, 不逐行刷新.
+* 支持的格式:
+*   CSV  按 RFC 4180 转义, 可选 GB18030(Excel 默认打开不乱码) 或 UTF-8 编码
+*   XLSX 原生 Excel 工作簿, 保留合并单元格, 纯数字单元格写为数值
+*   JSON 按列存储的单元格列表, 便于数据分析, 格式为
+*        {"format": "qcr-columnar", "count": n,
+*         "columns": {"sheet": [...], "row": [...], "col": [...], "row_span": [...],
+*                     "col_span": [...], "text": [...], "left": [...], "top": [...],
+*                     "right": [...], "bottom": [...]}}
+* 批量导出时可以每个表格写一个文件, 也可以把所有表格合并写入一个文件:
+* CSV 增加首列 sheet, XLSX 每个表格一个工作表, JSON 通过 sheet 列区分.
+*/
+
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include <QString>
+
+#include <string>
+#include <vector>
+
+#include "include/table_model.h"
+
+enum class ExportFormat
+{
+    Csv,
+    Xlsx,
+    Json,
+};
+
+enum class ExportEncoding
+{
+    Gb18030,
+    Utf8,
+};
+
+struct ExportOptions
+{
+    ExportFormat format = ExportFormat::Csv;
+    ExportEncoding encoding = ExportEncoding::Gb18030;  // 只对 CSV 有效, 其他格式均为 UTF-8
+};
+
+// 批量导出的一个表格
+struct ExportSheet
+{
+    QString name;
+    const TableModel *table;
+};
+
+// 格式对应的文件扩展名, 不含 '.'
+QString exportSuffix(ExportFormat format);
+
+/*
+* @brief 导出单个表格
+* @param path 输出文件路径
+* @param error 失败时的错误信息
+* @return 成功返回true
+*/
+bool exportTable(const TableModel &table, const QString &path,
+    const ExportOptions &options, QString &error);
+
+/*
+* @brief 批量导出
+* @param path single_file 为 true 时为输出文件路径, 否则为输出目录,
+*  每个表格写入该目录下的 <name>.<扩展名>
+* @param single_file 是否将所有表格写入同一个文件
+* @return 全部成功返回true, 否则 error 为第一个错误
+*/
+bool exportSheets(const std::vector<ExportSheet> &sheets, const QString &path,
+    const ExportOptions &options, bool single_file, QString &error);
+
+#endif // EXPORTER_H
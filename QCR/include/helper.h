@@ -18,10 +18,21 @@
 QString getCurTimeString();
 
 /*
-* @brief 初始化spdlog
+* @brief 初始化spdlog, 日志异步写入, 按天分割并保留最近30天的日志文件
 */
 bool initSpdLogger();
 
+/*
+* @brief 写完队列中剩余的日志并关闭spdlog, 程序退出前调用
+*/
+void closeSpdLogger();
+
+/*
+* @brief 清除30天以前的log文件. spdlog 只在运行中跨过零点时才删除旧文件,
+*  每天启动、关闭的程序需要在启动时清理
+*/
+void cleanLog();
+
 /*
 * @brief 打印日志
 * 
@@ -34,9 +45,23 @@ void printLog(const std::string &log, bool save = true);
 void printLog(const char *log, bool save = true);
 
 /*
-* @brief 清除30天以前的log文件
+* @brief 打印识别服务返回的数据等大段内容, 控制台只显示开头部分,
+*  完整内容以 debug 级别写入日志文件
+*
+* @param tag 内容说明
+* @param payload 内容
 */
-void cleanLog();
+void printPayload(const std::string &tag, const std::string &payload);
+
+/*
+* @brief 录制识别服务返回的原始数据, 供 benchmark 的 pipeline 及 eval 测试使用.
+*  设置环境变量 QCR_RECORD_FIXTURES=目录 后写入 目录/name.suffix.json, 未设置时不做任何事
+*
+* @param name 图片文件名(不含扩展名)
+* @param suffix 服务名, "tx" 或 "bd"
+* @param payload 内容
+*/
+void recordFixture(const QString &name, const char *suffix, const std::string &payload);
 
 /*
 * @brief 计算平均值和标准差
@@ -84,6 +109,25 @@ bool are_same_column(int l1, int r1, int l2, int r2);
 */
 std::vector<std::vector<cv::Point>> recognizeTable(const cv::String path);
 
+// 表格线检测的中间结果及格点
+struct TableLines
+{
+    cv::Mat binary;  // 二值化后的图片, 黑底白字
+    cv::Mat mask_h;  // 横线
+    cv::Mat mask_v;  // 竖线
+    std::vector<std::vector<cv::Point>> points;  // 格点矩阵, points[row][col]
+};
+
+/*
+* @brief 识别图片中的表格线及格点
+* 
+* @param mat 图片
+* @param table_lines 识别结果, 失败时 points 为空
+* 
+* @return 识别到至少2条横线和2条竖线时返回true
+*/
+bool recognizeTable(const cv::Mat &mat, TableLines &table_lines);
+
 /*
 * @brief 鉴于本程序仅用于识别表格, 因此仅存在横线和竖线, 因此可以简单的认为
 *  检测到的斜率要么为0, 要么无穷大, 即判断多条直线是否画面中同一条线, 可以简
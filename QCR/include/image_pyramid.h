@@ -0,0 +1,52 @@
+﻿/*
+* 显示用的图像金字塔. 第 0 层为原图(与传入的 cv::Mat 共享数据), 之后每层长宽减半,
+* 直到长边不超过一个瓦片. 各层按 TILE_SIZE 切分为瓦片, 只在需要显示时转换为 QPixmap,
+* 转换后的瓦片放在按内存大小淘汰的缓存中, 避免为大图生成整张全分辨率的 QPixmap.
+*/
+
+#ifndef IMAGE_PYRAMID_H
+#define IMAGE_PYRAMID_H
+
+#include <QCache>
+#include <QPixmap>
+#include <QSize>
+
+#include <opencv2/core.hpp>
+
+#include <vector>
+
+class ImagePyramid
+{
+public:
+    static constexpr int TILE_SIZE = 256;
+
+    /*
+    * @param cache_mb 瓦片缓存的上限(MB)
+    */
+    explicit ImagePyramid(int cache_mb = 128);
+
+    // 重新生成金字塔并清空瓦片缓存
+    void setImage(const cv::Mat &img);
+    void clear();
+
+    bool isNull() const { return levels_.empty(); }
+    // 原图
+    const cv::Mat &image() const;
+    QSize size() const;
+
+    int levelCount() const { return static_cast<int>(levels_.size()); }
+    QSize levelSize(int level) const;
+    /*
+    * @brief 显示比例为 zoom(显示像素/原图像素)时使用的层, 即分辨率不低于显示需要的最小的一层
+    */
+    int levelFor(double zoom) const;
+
+    // 第 level 层第 (tx, ty) 个瓦片, 边缘的瓦片可能小于 TILE_SIZE
+    QPixmap tile(int level, int tx, int ty);
+
+private:
+    std::vector<cv::Mat> levels_;
+    QCache<quint64, QPixmap> tiles_;  // 以 KB 为单位计算大小
+};
+
+#endif  // IMAGE_PYRAMID_H
@@ -3,10 +3,17 @@
 
 #include <QFrame>
 #include <QMouseEvent>
+#include <QWheelEvent>
 #include <include/helper.h>
+#include <include/image_pyramid.h>
 
 constexpr int CIRCLE_SIZE = 10;
 
+/*
+* 图片显示控件. 图片保存为图像金字塔, 只绘制可见区域的瓦片, 并根据缩放比例选择金字塔的层.
+* 默认适应窗口大小; 滚轮以鼠标位置为中心缩放, 在截取框顶点以外按住左键拖动平移,
+* 双击在适应窗口和原始大小之间切换. 截取框和选中的格子按相对坐标保存, 绘制时经过缩放变换.
+*/
 class ImageWidget : public QFrame
 {
     Q_OBJECT
@@ -15,8 +22,9 @@ public:
     ImageWidget(QWidget *parent = nullptr);
     ~ImageWidget();
 
-    void setPix(QPixmap pix);
-    QPixmap getPix();   // 获取src_pix
+    // 与 img 共享数据, 调用者不应再原地修改 img
+    void setImage(const cv::Mat &img);
+    const cv::Mat &image() const;   // 获取原图
     void getSize(int &width, int &height);
     void rotateImage();
     void inVertex(const QPoint &pos);
@@ -27,7 +35,8 @@ public:
     bool isOk(const QPoint &p);
     // 获取垂足坐标
     QPoint getNeareastPoint(const QPoint &p);
-    void drawImage(QPainter &painter);
+    // 绘制与 dirty 相交的瓦片
+    void drawImage(QPainter &painter, const QRect &dirty);
     void setInterceptBox(const std::vector<std::vector<double>> &points);
     void drawInterceptBox(QPainter &painter);
     void setSelectedRect(const std::vector<std::vector<double>> &points);
@@ -37,19 +46,41 @@ public:
     void mousePressEvent(QMouseEvent *event);
     void mouseMoveEvent(QMouseEvent *event);
     void mouseReleaseEvent(QMouseEvent *event);
+    void mouseDoubleClickEvent(QMouseEvent *event);
+    void wheelEvent(QWheelEvent *event);
     void paintEvent(QPaintEvent *event);
+    void resizeEvent(QResizeEvent *event);
 
 private:
-    QPixmap src_pix;             // 原始图片
-    QPixmap scaled_pix;          // 缩放后的图片
-    double img_scale = 1.0;      // scaled/src
+    // 相对坐标与控件坐标的转换
+    QPointF relToWidget(const QPointF &p) const;
+    QPointF widgetToRel(const QPointF &p) const;
+    // 图片在控件中的显示范围
+    QRectF imageRect() const;
+    // 适应窗口时的缩放比例
+    double fitZoom() const;
+    void fitToWindow();
+    // 以控件坐标 anchor 为中心缩放到 zoom
+    void zoomAt(const QPointF &anchor, double zoom);
+    // 图片小于控件时居中, 否则不留空白
+    void clampOffset();
+
+    // 拖动第 index 个顶点时需要重绘的区域, 即该顶点及相邻两条边
+    QRect vertexDirtyRect(int index) const;
+    // 移动第 vertex_index 个顶点并只重绘变化的区域
+    void moveVertex(const QPoint &p);
+
+    ImagePyramid pyramid;        // 原始图片
+    double zoom = 1.0;           // 显示像素/原图像素
+    QPointF offset;              // 图片左上角在控件中的位置
+    bool fit_mode = true;        // 适应窗口, 控件大小改变时重新计算缩放比例
+    bool panning = false;
+    QPoint pan_pos;              // 平移时上一次的鼠标位置
     QVector<QPoint> intercept_abs;   // 以 widget 为参照的左上、右上、右下、左下
     QVector<QPointF> intercept_rel;  // 以图片为参照的相对坐标
     QVector<QPointF> selected_rect;  // 选中的格子的相对坐标
     bool initial = true;
     int vertex_index = -1;
-    int h_margin = 0;
-    int v_margin = 0;
 };
 
 #endif  // IMAGE_WIDGET_H
@@ -0,0 +1,128 @@
+﻿/*
+* 后台任务队列. 识别、优化等耗时操作提交到队列后在后台线程中按提交顺序执行, 界面线程不再阻塞,
+* 前一张表格未处理完时也可以提交下一张. 任务通过 JobContext 报告进度并检查是否已被取消,
+* 进度及完成通过信号通知界面线程, 完成回调同样在界面线程中执行:
+*
+*     job_queue.submit(name, [=](JobContext &job) {
+*         job.progress(QString::fromUtf8(u8"识别"), 1, 3);
+*         if (job.stopRequested())
+*             return;
+*         ...
+*     }, [=](bool cancelled) { ... });
+*/
+
+#ifndef JOB_QUEUE_H
+#define JOB_QUEUE_H
+
+#include <QObject>
+#include <QString>
+#include <QMetaType>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "include/stop_token.h"
+
+// 任务进度, total 为 0 时表示数量未知
+struct JobProgress
+{
+    QString stage;   // 当前阶段
+    int done = 0;    // 已完成的数量
+    int total = 0;   // 总数量
+
+    // 百分比, 数量未知时返回-1
+    int percent() const { return total > 0 ? done * 100 / total : -1; }
+};
+Q_DECLARE_METATYPE(JobProgress)
+
+class JobQueue;
+
+// 传给任务函数的上下文
+class JobContext
+{
+public:
+    JobContext(JobQueue *queue, int id, StopToken token)
+        : queue_(queue), id_(id), token_(std::move(token))
+    {
+    }
+
+    int id() const { return id_; }
+    const StopToken &token() const { return token_; }
+    bool stopRequested() const { return token_.stopRequested(); }
+
+    // 报告进度, 可以在任意线程中调用
+    void progress(const QString &stage, int done = 0, int total = 0);
+    // 转换为不依赖 Qt 的进度回调, 供识别流程中的函数使用
+    ProgressCallback callback();
+
+private:
+    JobQueue *queue_;
+    int id_;
+    StopToken token_;
+};
+
+class JobQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    using Work = std::function<void(JobContext &job)>;
+    // 在界面线程中调用, cancelled 为true时任务被取消或未执行
+    using Done = std::function<void(bool cancelled)>;
+
+    /*
+    * @param workers 后台线程数, 为1时任务依次执行, 大于1时按提交顺序开始并同时执行
+    */
+    explicit JobQueue(QObject *parent = nullptr, int workers = 1);
+    // 取消所有任务并等待后台线程结束
+    ~JobQueue();
+
+    /*
+    * @brief 提交任务, 按提交顺序开始执行
+    * @return 任务编号
+    */
+    int submit(const QString &name, Work work, Done done = nullptr);
+
+    // 取消排队中或正在执行的任务, 正在执行的任务在下一次检查时返回
+    void cancel(int id);
+    void cancelAll();
+    // 正在执行及排队中的任务数量
+    int pendingCount() const;
+
+signals:
+    void jobQueued(int id, QString name);
+    void jobStarted(int id, QString name);
+    void jobProgress(int id, JobProgress progress);
+    void jobFinished(int id, QString name, bool cancelled);
+
+private:
+    friend class JobContext;
+
+    struct Job
+    {
+        int id;
+        QString name;
+        Work work;
+        Done done;
+        StopToken token;
+    };
+
+    void run();
+    // 在界面线程中执行完成回调并发出 jobFinished
+    void finish(Job &job, bool cancelled);
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Job> jobs_;
+    std::map<int, StopToken> running_;  // 正在执行的任务
+    int next_id_ = 1;
+    bool quit_ = false;
+    std::vector<std::thread> workers_;
+};
+
+#endif  // JOB_QUEUE_H
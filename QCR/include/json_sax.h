@@ -0,0 +1,87 @@
+﻿#ifndef JSON_SAX_H
+#define JSON_SAX_H
+
+#include <nlohmann/json.hpp>
+using json = nlohmann::json;
+
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+* 记录当前路径的 SAX 解析基类, 用于流式解析服务商返回的数据, 不构建 json 对象.
+* 路径中对象成员以键名表示, 数组元素统一以 "[]" 表示, 例如
+* Response.TableDetections[].Cells[] 对应 match({"Response", "TableDetections", "[]", "Cells", "[]"}).
+* 子类只需处理关心的路径上的事件.
+*/
+class PathSax : public nlohmann::json_sax<json>
+{
+public:
+    bool null() override { return true; }
+    bool boolean(bool) override { return true; }
+    bool number_integer(number_integer_t val) override { onNumber(static_cast<double>(val)); return true; }
+    bool number_unsigned(number_unsigned_t val) override { onNumber(static_cast<double>(val)); return true; }
+    bool number_float(number_float_t val, const string_t &) override { onNumber(val); return true; }
+    bool string(string_t &val) override { onString(val); return true; }
+    bool binary(binary_t &) override { return true; }
+
+    bool start_object(std::size_t) override { push(false); onStart(false); return true; }
+    bool end_object() override { onEnd(false); frames_.pop_back(); return true; }
+    bool start_array(std::size_t) override { push(true); onStart(true); return true; }
+    bool end_array() override { onEnd(true); frames_.pop_back(); return true; }
+    bool key(string_t &val) override { key_.swap(val); return true; }
+
+    bool parse_error(std::size_t, const std::string &, const nlohmann::detail::exception &ex) override
+    {
+        error_ = ex.what();
+        return false;
+    }
+
+    // 解析失败时的错误信息
+    const std::string &error() const { return error_; }
+
+protected:
+    // 数值及字符串, 此时 match 匹配的是所在的容器, name() 为该值的键名
+    virtual void onNumber(double) {}
+    virtual void onString(std::string &) {}
+    // 对象或数组的开始和结束, 此时 match 匹配的是该容器本身
+    virtual void onStart(bool) {}
+    virtual void onEnd(bool) {}
+
+    // 当前路径(不含根节点)是否与 keys 相同
+    bool match(std::initializer_list<std::string_view> keys) const
+    {
+        if (frames_.size() != keys.size() + 1)
+            return false;
+        size_t i = 1;
+        for (std::string_view k : keys)
+        {
+            if (frames_[i++].name != k)
+                return false;
+        }
+        return true;
+    }
+
+    // 当前值的键名, 数组元素为 "[]"
+    const std::string &name() const { return frames_.back().array ? array_name_ : key_; }
+
+private:
+    struct Frame
+    {
+        std::string name;
+        bool array;
+    };
+
+    void push(bool array)
+    {
+        frames_.push_back({ frames_.empty() ? std::string() : name(), array });
+    }
+
+    std::vector<Frame> frames_;
+    std::string key_;
+    std::string error_;
+    const std::string array_name_ = "[]";
+};
+
+#endif // JSON_SAX_H
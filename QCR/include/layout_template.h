@@ -0,0 +1,87 @@
+﻿/*
+* 版式模板. 同一学校的成绩登记表通常使用同一模板, 第一次识别后把表格的格点、
+* 表头文本及分数列保存为模板, 之后的图片先与模板比较表格线的相对位置(线签名),
+* 匹配成功时用格点对应关系求出单应矩阵, 将模板中的单元格几何变换到当前图片,
+* 不再需要整张表格的云端识别及分数列的推断. 表头以下的姓名、学号等每张表都不同,
+* 模板中不保存, 由调用者另行识别.
+*
+* 模板保存在 data/templates 目录下, 每个模板一个 json 文件:
+* {
+*   "version": 1,
+*   "name": "name",
+*   "grid": [[[x, y], ...], ...],  // 格点矩阵, grid[row][col]
+*   "score_columns": [col, ...],
+*   "score_row": row,               // 分数区域的首行
+*   "cells": {...}                  // TableModel::toJson, 只有表头有文本
+* }
+*/
+
+#ifndef LAYOUT_TEMPLATE_H
+#define LAYOUT_TEMPLATE_H
+
+#include <QString>
+
+#include <opencv2/core.hpp>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "include/table_model.h"
+
+const QString TEMPLATE_DIR = "./data/templates";
+
+struct LayoutTemplate
+{
+    std::string name;
+    std::vector<std::vector<cv::Point>> grid;  // 模板图片中的格点矩阵
+    std::vector<double> col_signature;  // 各竖线在表格宽度中的相对位置, 首尾为0和1
+    std::vector<double> row_signature;  // 各横线在表格高度中的相对位置
+    TableModel cells;                   // 单元格几何及表头文本
+    std::vector<int> score_columns;     // 分数列的列号
+    int score_row = 0;                  // 分数区域的首行, 以上为表头
+};
+
+/*
+* @brief 根据当前图片及识别结果生成模板
+* @param img 校正后的表格图片
+* @param result 表格识别结果
+* @param score_rects 分数列范围[col, left, right, top, bottom], 只保存第一个分数格子以上的表头文本
+* @return 图片中识别不到表格线时返回false
+*/
+bool makeLayoutTemplate(const cv::Mat &img, const TableModel &result,
+    const std::vector<std::vector<int>> &score_rects, const std::string &name, LayoutTemplate &tpl);
+
+// 模板库, 可以在多个线程中同时使用
+class TemplateRegistry
+{
+public:
+    // 读取目录下的所有模板, 返回读取成功的数量
+    int load(const QString &dir = TEMPLATE_DIR);
+
+    /*
+    * @brief 添加模板并保存到目录下, 同名模板会被覆盖
+    * @return 保存失败时返回false, 此时模板不会加入模板库
+    */
+    bool add(LayoutTemplate tpl, const QString &dir = TEMPLATE_DIR);
+
+    bool empty() const;
+
+    /*
+    * @brief 将图片与所有模板比较, 取线签名差异最小且低于阈值的模板
+    * @param img 校正后的表格图片
+    * @param model 变换到当前图片的单元格, 表头以下的文本为空
+    * @param score_columns 模板的分数列
+    * @param score_row 模板的分数区域首行
+    * @param name 不为空时写入匹配到的模板名
+    * @return 匹配成功返回true
+    */
+    bool match(const cv::Mat &img, TableModel &model, std::vector<int> &score_columns,
+        int &score_row, std::string *name = nullptr) const;
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<LayoutTemplate> templates_;
+};
+
+#endif // LAYOUT_TEMPLATE_H
@@ -0,0 +1,29 @@
+﻿/*
+* 本地表格结构识别, 不依赖云端服务. 在 recognizeTable 得到的格点矩阵上,
+* 沿相邻格子之间的边检查是否存在表格线, 不存在则合并为跨行/跨列的单元格,
+* 输出与服务商识别结果相同的 TableModel(文本为空).
+* 同时根据每个格子中笔画的连通域形状判断哪些列为纯数字列, 这些列的内容
+* 可以直接由本地的数字识别得到.
+*/
+
+#ifndef LOCAL_GRID_H
+#define LOCAL_GRID_H
+
+#include <opencv2/core.hpp>
+
+#include <vector>
+
+#include "include/table_model.h"
+
+/*
+* @brief 识别表格结构
+* @param img 校正后的表格图片
+* @param model 识别结果, 单元格文本为空
+* @param digit_columns 不为空时写入纯数字列的列号
+* @param score_row 不为空时写入纯数字列中第一个数字格子所在的行, 以上为表头; 没有纯数字列时为0
+* @return 识别到表格时返回true
+*/
+bool detectTableGrid(const cv::Mat &img, TableModel &model, std::vector<int> *digit_columns = nullptr,
+    int *score_row = nullptr);
+
+#endif // LOCAL_GRID_H
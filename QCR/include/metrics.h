@@ -0,0 +1,157 @@
+﻿/*
+* 运行指标统计, 格式与 Prometheus 文本格式一致. 各处理阶段通过全局的
+* MetricsRegistry 获取计数器、仪表及直方图, 首次获取时注册(加锁), 之后
+* 保存引用直接使用, 更新只涉及原子变量, 不加锁:
+*
+*     static Counter &sheets = metrics().counter("qcr_sheets_processed_total", "...");
+*     sheets.inc();
+*
+* 同名指标可以带不同的标签, 标签以 Prometheus 格式给出, 如 provider="tx".
+* 设置环境变量 QCR_METRICS_PORT 后在 127.0.0.1 的该端口提供 /metrics 接口,
+* 设置 QCR_METRICS_FILE 后程序退出时将指标写入该文件.
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Counter
+{
+public:
+    void inc(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value_{ 0 };
+};
+
+class Gauge
+{
+public:
+    void set(int64_t v) { value_.store(v, std::memory_order_relaxed); }
+    void add(int64_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value_{ 0 };
+};
+
+// 固定分桶的直方图, bounds 为各桶的上界(升序), 最后隐含 +Inf 桶
+class Histogram
+{
+public:
+    explicit Histogram(std::vector<double> bounds);
+
+    void observe(double v);
+
+    const std::vector<double> &bounds() const { return bounds_; }
+    // 第 i 个桶(不累计)的数量, i == bounds().size() 为 +Inf 桶
+    uint64_t bucket(size_t i) const { return buckets_[i].load(std::memory_order_relaxed); }
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    double sum() const { return sum_.load(std::memory_order_relaxed); }
+
+private:
+    std::vector<double> bounds_;
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets_;
+    std::atomic<uint64_t> count_{ 0 };
+    std::atomic<double> sum_{ 0 };
+};
+
+// 耗时直方图的默认分桶, 单位为秒
+const std::vector<double> &latencyBuckets();
+
+class MetricsRegistry
+{
+public:
+    /*
+    * @brief 获取指标, 不存在时注册. 返回的引用在程序运行期间一直有效
+    * @param name 指标名称
+    * @param help 说明, 以第一次注册时为准
+    * @param labels 标签, 如 provider="tx",endpoint="table", 可以为空
+    */
+    Counter &counter(const std::string &name, const std::string &help, const std::string &labels = "");
+    Gauge &gauge(const std::string &name, const std::string &help, const std::string &labels = "");
+    Histogram &histogram(const std::string &name, const std::string &help, const std::string &labels = "",
+        const std::vector<double> &bounds = latencyBuckets());
+
+    // 按 Prometheus 文本格式输出所有指标
+    std::string render() const;
+
+    bool dump(const std::string &path) const;
+
+private:
+    enum Type
+    {
+        COUNTER,
+        GAUGE,
+        HISTOGRAM,
+    };
+    struct Series
+    {
+        std::string labels;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+    };
+    struct Family
+    {
+        Type type;
+        std::string help;
+        std::vector<Series> series;
+    };
+
+    Series &series(const std::string &name, const std::string &help, const std::string &labels, Type type);
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Family> families_;
+};
+
+MetricsRegistry &metrics();
+
+// 作用域计时, 析构时将耗时(秒)写入直方图
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(Histogram &histogram)
+        : histogram_(histogram), begin_(std::chrono::steady_clock::now())
+    {
+    }
+    ~ScopedTimer()
+    {
+        histogram_.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin_).count());
+    }
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+    Histogram &histogram_;
+    std::chrono::steady_clock::time_point begin_;
+};
+
+// 各处理阶段的耗时直方图 qcr_stage_seconds{stage="..."}
+Histogram &stageHistogram(const char *stage);
+
+#define METRICS_CONCAT_IMPL(a, b) a##b
+#define METRICS_CONCAT(a, b) METRICS_CONCAT_IMPL(a, b)
+// 统计所在作用域的耗时, 直方图只在第一次执行时查找
+#define STAGE_TIMER(stage) \
+    static Histogram &METRICS_CONCAT(stage_histogram_, __LINE__) = stageHistogram(stage); \
+    ScopedTimer METRICS_CONCAT(stage_timer_, __LINE__)(METRICS_CONCAT(stage_histogram_, __LINE__))
+
+/*
+* @brief 读取环境变量 QCR_METRICS_PORT 及 QCR_METRICS_FILE, 按需启动 /metrics 服务
+*/
+void initMetrics();
+
+// 停止 /metrics 服务, 并按需将指标写入文件
+void finishMetrics();
+
+#endif // METRICS_H
@@ -0,0 +1,28 @@
+﻿#ifndef MORPHOLOGY_H
+#define MORPHOLOGY_H
+
+#include <opencv2/core.hpp>
+
+/*
+* 横线/竖线结构元素的形态学运算, 使用 van Herk/Gil-Werman 算法实现,
+* 每个像素只需约3次 min/max 比较, 计算量与结构元素长度无关.
+* 结果与 cv::erode/cv::dilate 使用 cv::MORPH_RECT 的 len×1 或 1×len
+* 结构元素、默认锚点及默认边界时完全一致.
+*/
+
+/*
+* @brief 线形结构元素腐蚀
+* @param src 8位单通道图像
+* @param dst 输出图像, 可以与 src 为同一对象
+* @param len 结构元素长度
+* @param horizontal true 为横向结构元素(len×1), false 为竖向(1×len)
+* @param iterations 迭代次数
+*/
+void erodeLine(const cv::Mat &src, cv::Mat &dst, int len, bool horizontal, int iterations = 1);
+
+/*
+* @brief 线形结构元素膨胀, 参数同 erodeLine
+*/
+void dilateLine(const cv::Mat &src, cv::Mat &dst, int len, bool horizontal, int iterations = 1);
+
+#endif // MORPHOLOGY_H
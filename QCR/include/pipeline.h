@@ -0,0 +1,78 @@
+﻿/*
+* 识别流程中与界面无关的各处理阶段, 界面和基准测试共用.
+* 数字的格式为 [col, left, right, top, bottom, num], 坐标相对于校正后的图片;
+* 分数列范围的格式为 [col, left, right, top, bottom].
+*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <opencv2/core.hpp>
+
+#include <vector>
+
+#include "include/table_model.h"
+#include "include/stop_token.h"
+
+/*
+* @brief 按四个顶点对图片做透视变换, 得到校正后的表格图片
+* @param points_rel 四个顶点相对于图片宽高的坐标, 依次为左上、右上、右下、左下
+*/
+cv::Mat warpTable(const cv::Mat &img, const std::vector<std::vector<double>> &points_rel);
+
+// 获取去除边框后的二值图像, 黑底白字
+cv::Mat removeTableBorders(const cv::Mat &img);
+
+/*
+* @brief 根据某一列的文本内容判断其是否是分数列, 返回所有分数列的像素范围
+* @param digit_columns 本地识别或版式模板给出的分数列, 不为空时不再根据文本判断
+* @param score_row 分数区域的首行, 以上的表头不计入分数列范围
+*/
+void getScoreColumns(const TableModel &model, const std::vector<int> &digit_columns,
+    std::vector<std::vector<int>> &rects, int score_row = 0);
+
+// 数字提取及拼接的阈值, 默认值为界面使用的值, 评估工具会对其进行扫描
+struct DigitParams
+{
+    // 字符连通域外接矩形的尺寸范围(像素)
+    int min_height = 12;
+    int max_height = 80;
+    int min_width = 6;
+    int max_width = 60;
+    // 宽高比上限 aspect_num / aspect_den, 超过则认为不是数字
+    int aspect_num = 3;
+    int aspect_den = 2;
+    // 上下相邻的两个字符竖直重叠超过较小高度的 1/splice_ratio 时认为在同一行
+    int splice_ratio = 3;
+};
+
+/*
+* @brief 获取提取到的每个字符的坐标及其识别结果, 相对于切割前的图片
+* @param token 请求停止时不再识别, words_col 不变
+*/
+void extractWords(const cv::Mat &mat, const std::vector<int> &rect,
+    std::vector<std::vector<int>> &words_col, const DigitParams &params = DigitParams(),
+    const StopToken &token = StopToken());
+
+// 将同一行识别到的多个数字拼接在一起
+void spliceWords(std::vector<std::vector<std::vector<int>>> &words, const DigitParams &params = DigitParams());
+
+/*
+* @brief 融合OCR和数字识别的结果
+* @return 被修改的单元格索引
+*/
+std::vector<int> fuseWords(TableModel &model, const std::vector<std::vector<std::vector<int>>> &words);
+
+/*
+* @brief 优化分数列的识别结果: 去除边框与分数列判断并行, 各分数列并行提取并识别数字,
+*  最后拼接并融合到 model 中
+* @param img 校正后的表格图片
+* @param score_row 分数区域的首行, 见 getScoreColumns
+* @param token 请求停止时不修改 model, 返回空结果
+* @param progress 每完成一个分数列报告一次进度
+* @return 被修改的单元格索引
+*/
+std::vector<int> optimizeTable(const cv::Mat &img, TableModel &model, const std::vector<int> &digit_columns,
+    int score_row = 0, const StopToken &token = StopToken(), const ProgressCallback &progress = nullptr);
+
+#endif // PIPELINE_H
@@ -1,64 +1,131 @@
 ﻿#pragma once
 
 #include <QThread>
+#include <QCache>
+#include <QLabel>
+#include <QListWidget>
+#include <QDockWidget>
+#include <QProgressBar>
+#include <QToolButton>
 
 #include <opencv2/core.hpp>
 #include <nlohmann/json.hpp>
 using json = nlohmann::json;
 
+#include <atomic>
+#include <deque>
 #include <iostream>
+#include <mutex>
 
 #include "ui_qcr.h"
 #include "include/config_dialog.h"
 #include "include/about_dialog.h"
-#include "include/loading_animation.h"
+#include "include/job_queue.h"
+#include "include/table_model.h"
+#include "include/result_table_model.h"
+#include "include/layout_template.h"
+#include "include/workspace.h"
+#include "include/exporter.h"
 
 
+// 同时加载表格图片的线程数
+constexpr int PREPARE_WORKERS = 3;
+// 批量处理时最多预读的表格数, 已加载但未识别完的表格计入其中, 限制同时解码的图片占用的内存
+constexpr int PREPARE_LOOKAHEAD = 6;
+
+// 识别服务的设置, 提交任务时在界面线程中读取, 工作线程中不再访问设置对话框
+struct OcrSettings
+{
+    std::string tx_url;
+    std::string tx_secret_id;
+    std::string tx_secret_key;
+    std::string bd_request_url;
+    std::string bd_get_result_url;
+    std::string bd_get_token_url;
+    std::string bd_api_key;
+    std::string bd_secret_key;
+};
+
+// 一次识别任务的结果, 在工作线程中生成, 完成后在界面线程中应用
+struct OcrOutput
+{
+    bool success = false;
+    TableModel model;
+    // 本地识别或版式模板给出的分数列, 为空时根据文本内容判断分数列
+    std::vector<int> digit_columns;
+    int score_row = 0;  // 分数区域的首行, 见 getScoreColumns
+};
+
 class QCR : public QMainWindow
 {
     Q_OBJECT
 
 public:
     QCR(QWidget *parent = Q_NULLPTR);
-    int getBdAccessToken();
-    void resizeImage(const QString &path, int len, int sz);
+    // 在界面线程中读取识别服务的设置
+    OcrSettings ocrSettings() const;
+    /*
+    * @brief 返回百度Access Token, 没有时读取当天的本地文件或重新获取, 可以在任意线程中调用
+    * @return 获取失败时返回空字符串
+    */
+    std::string bdAccessToken(const OcrSettings &settings);
+    // 当前显示的表格, 还没有打开图片时返回 nullptr
+    Sheet *currentSheet();
     /*
-    * @brief 合并霍夫变换检测的线段并计算四个交点坐标
-    * @param lines 检测到的线段
-    * @param points 四个交点坐标, 分别是[left-up, right-up, right-bottom, left-bottom]
+    * @brief 在后台加载表格的图片. 首次加载时按设置识别轮廓;
+    *  批量处理的表格(一次打开多张图片或多页文档)按轮廓校正后继续识别
     */
-    void getVertexes(std::vector<cv::Vec4i> &lines, std::vector<cv::Point> &points);
-    // 边缘检测主要是拿到4个顶点的相对坐标, 可以将图片缩小以加快处理速度
+    void prepareSheet(int id);
+    // 批量处理时在预读名额内依次加载等待中的表格
+    void schedulePrepare();
+    // 批量处理的表格加载失败或识别结束, 归还预读名额
+    void finishBatch(int id);
+    // 在后台识别/优化指定的表格, 完成后结果写入该表格
+    void submitOcr(int id);
+    void submitOptimize(int id);
+    // 显示当前表格的图片及截取框, 并更新工具栏按钮
+    void showSheetImage();
+    void updateSheetItem(int id);
+    // 图片内存超过预算时释放已完成表格的图片
+    void evictSheets();
+    // 在工作线程中识别轮廓, 同一图片的结果会被缓存
     void edgeDetection();
-    void runTxOcr(const std::string &base64_img);
-    void runBdOcr(const std::string &base64_img);
-    void updateTableCell(int row, int col, int row_span, int col_span, const QString &text);
-    void updateTable();
-    void reset();
-    void txParseData(const std::string &str);
-    void bdParseData(const std::string &str);
-    // 根据某一列的文本内容判断其是否是分数列, 返回所有分数列的像素范围及其对应的列数[col, left, right, top, bottom]
-    void getScoreColumn(std::vector<std::vector<int>> &rects);
-    // 获取去除边框后的图像
-    cv::Mat removeTableBorders();
-    // 获取提取到的每个字符的坐标及其识别结果, 相对于切割前的图片[col, left, right, top, bottom, num]
-    void extractWords(cv::Mat mat, std::vector<int> rect,
-        std::vector<std::vector<std::vector<int>>> &words);
+    // 以下识别函数在任务队列的工作线程中执行, 结果写入 out.
+    // fixture 为录制返回数据时使用的文件名, 见 recordFixture
+    void runTxOcr(const OcrSettings &settings, const std::string &base64_img, const QString &fixture,
+        JobContext &job, OcrOutput &out);
+    void runBdOcr(const OcrSettings &settings, const std::string &base64_img, const QString &fixture,
+        JobContext &job, OcrOutput &out);
+    // 本地识别表格结构, 纯数字列以外的文字单元格交给 runCropOcr
+    void runLocalOcr(const OcrSettings &settings, const cv::Mat &img, JobContext &job, OcrOutput &out);
     /*
-    * @brief 拼接识别出的同一行的多个数字
+    * @brief 只把 cells 所在区域发送给已配置的通用文字识别接口(优先腾讯), 识别结果写入 model.
+    *  两个服务商都未配置时不识别, 单元格保持为空
     */
-    void combine(std::vector<std::vector<int>> &words, std::vector<int> &word);
-    // 将同一行识别到的多个数字拼接在一起
-    void spliceWords(std::vector<std::vector<std::vector<int>>> &words);
-    // 融合OCR和数字识别的结果
-    void fusion(std::vector<std::vector<std::vector<int>>> &words);
+    void runCropOcr(const OcrSettings &settings, const cv::Mat &img, const std::vector<int> &cells,
+        JobContext &job, TableModel &model);
+    // 与版式模板匹配, 成功时直接使用模板的单元格及分数列, 表头以下的文字单元格交给 runCropOcr
+    bool runTemplateOcr(const OcrSettings &settings, const cv::Mat &img, JobContext &job, OcrOutput &out);
+    // 用新的识别结果刷新表格
+    void updateTable(OcrOutput &out);
+    void reset();
+    void txParseData(const std::string &str, OcrOutput &out);
+    // 解析获取结果接口的返回数据, 任务结束(完成或出错)时返回true, 仍在处理中时返回false
+    bool bdParseData(const std::string &str, OcrOutput &out);
     void closeEvent(QCloseEvent *event);
+    /*
+    * @brief 选择导出文件及格式, 扩展名与所选格式不一致时修正
+    * @return 取消时返回false
+    */
+    bool askExportPath(const QString &title, QString &path, ExportOptions &options);
 
 signals:
     void msg_signal(QString msg);
 
 public slots:
     void msg_box(QString msg);
+    // 轮廓识别完成, generation 为发起识别时的序号, key 为缓存的键
+    void setContour(quint64 generation, QString key, const std::vector<std::vector<double>> &points_rel);
 
     void openImage();
     void rotateImage();
@@ -67,10 +134,23 @@ public slots:
     void runOcr();
     void optimize();
     void exportTableData();
+    // 导出工作区中所有已识别的表格, 每个表格一个文件或合并为一个文件
+    void exportAllSheets();
+    // 将当前图片的表格结构及表头保存为版式模板
+    void saveTemplate();
 
     void drawSelectedCell(int row, int col);
+    // 切换到指定的表格, 当前表格的结果写回工作区
+    void selectSheet(int id);
+
+    // 在状态栏显示任务进度
+    void showJobProgress(int id, JobProgress progress);
+    void updateJobStatus();
 
 private:
+    // 获取百度Access Token写入 bd_access_token, 调用时需持有 bd_token_mutex
+    int getBdAccessToken(const OcrSettings &settings);
+
     Ui::QCRClass ui;
 
     QThread *initial_thread;
@@ -78,7 +158,12 @@ private:
 
     ConfigDialog config_dialog;  // 设置对话框
     AboutDialog about_dlg;       // 关于对话框
-    LoadingAnimation animation;  // 加载动画
+    QLabel *job_label;           // 状态栏: 当前任务及进度
+    QProgressBar *job_bar;
+    QToolButton *job_cancel;     // 取消当前任务
+    int current_job = -1;        // 正在执行的任务
+    QDockWidget *sheet_dock;     // 表格列表
+    QListWidget *sheet_list;
 
     QAction *act_open;    // 打开
     QAction *act_rotate;  // 旋转
@@ -87,29 +172,28 @@ private:
     QAction *act_restore; // 恢复
     QAction *act_ocr;     // 识别
     QAction *act_optimize;// 优化
+    QAction *act_template;// 模板
     QAction *act_export;  // 导出
     QAction *act_config;  // 设置
     QAction *act_about;   // 关于
 
-    cv::Mat src_img;      // 缩放后的原图
-    cv::Mat cropped_img;  // 后续处理都对该图进行处理
+    Workspace workspace;         // 打开的所有表格
+    int current_sheet = -1;      // 当前显示的表格
+    std::deque<int> prepare_backlog;  // 批量处理中等待加载的表格
+    int batch_in_flight = 0;     // 批量处理中已开始加载、尚未识别完的表格数
 
-    bool ocr_success; // 执行OCR识别是否成功
+    // 轮廓识别结果缓存, 以 Sheet::contourKey 为键, 打开时的自动识别与手动识别共用
+    QCache<QString, std::vector<std::vector<double>>> contour_cache{ 32 };
+    std::atomic<quint64> contour_generation{ 0 };  // 轮廓识别序号
+    std::mutex bd_token_mutex;   // 保护 bd_access_token, 识别任务与初始化线程都可能获取
     std::string bd_access_token; // 百度Access Token
 
-    /*
-    * 将数据统一格式化为:
-    * {
-    *   "[row]": {
-    *     "[col]": {
-    *       "row_span": 1,
-    *       "col_span": 1,
-    *       "text": "text",
-    *       "polygon": [[x1, y1],[x2,y2],[x3,y3],[x4,y4]]
-    *     }
-    *   }
-    * }
-    * 方便直接根据行列坐标定位某单元格的信息
-    */
-    json ocr_result = json::object();
+    // 当前表格的识别结果, 可以直接根据行列坐标定位某单元格的信息
+    TableModel ocr_result;
+    ResultTableModel *table_model;  // 表格视图的模型, 引用 ocr_result
+    TemplateRegistry template_registry;  // 版式模板库
+    // 识别、优化等耗时任务. 任务中会访问以上成员, 因此放在最后, 析构时最先等待任务结束
+    JobQueue job_queue;
+    // 图片加载及轮廓识别, 与 job_queue 并行, 下一张表格的加载与当前表格的识别同时进行
+    JobQueue prepare_queue;
 };
@@ -0,0 +1,47 @@
+﻿#ifndef RESULT_TABLE_MODEL_H
+#define RESULT_TABLE_MODEL_H
+
+#include <QAbstractTableModel>
+#include <QTableView>
+
+#include <vector>
+
+#include "include/table_model.h"
+
+/*
+* 识别结果表格的 Qt 模型, 直接读取 TableModel, 不为每个单元格创建 item.
+* 视图只请求可见单元格的数据, 而 TableModel::find 为 O(1), 因此刷新耗时只与
+* 可见单元格数量有关. 只能在界面线程中修改所引用的 TableModel, 在其他线程中
+* 得到的结果应通过 replace 替换.
+*/
+class ResultTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    explicit ResultTableModel(TableModel &table, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+    QSize span(const QModelIndex &index) const override;
+
+    // 替换整个表格, 表格结构发生变化
+    void replace(TableModel &&table);
+
+    /*
+    * @brief 通知视图这些单元格的文本已被修改, 合并为一次 dataChanged 信号
+    * @param cells 单元格在 TableModel 中的索引
+    */
+    void cellsChanged(const std::vector<int> &cells);
+
+    // 按 TableModel 中的跨行跨列设置视图的合并单元格
+    void applySpans(QTableView *view) const;
+
+private:
+    TableModel &table_;
+};
+
+#endif // RESULT_TABLE_MODEL_H
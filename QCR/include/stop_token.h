@@ -0,0 +1,66 @@
+﻿/*
+* 协作式取消. 任务持有 StopToken 的副本, 在循环、轮询或网络回调中检查 stopRequested(),
+* 发现已请求停止时尽快返回. 默认构造的 StopToken 永远不会停止, 可以作为默认参数.
+*/
+
+#ifndef STOP_TOKEN_H
+#define STOP_TOKEN_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+
+class StopToken
+{
+public:
+    StopToken() = default;
+
+    // 创建可以取消的 StopToken, 副本之间共享状态
+    static StopToken create()
+    {
+        StopToken token;
+        token.flag_ = std::make_shared<std::atomic<bool>>(false);
+        return token;
+    }
+
+    bool stopRequested() const
+    {
+        return flag_ && flag_->load(std::memory_order_relaxed);
+    }
+
+    void requestStop() const
+    {
+        if (flag_)
+            flag_->store(true, std::memory_order_relaxed);
+    }
+
+    /*
+    * @brief 等待 ms 毫秒, 每 50 毫秒检查一次是否请求停止
+    * @return 请求停止时提前返回true
+    */
+    bool sleepFor(int ms) const
+    {
+        constexpr int slice = 50;
+        for (int waited = 0; waited < ms; waited += slice)
+        {
+            if (stopRequested())
+                return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(std::min(slice, ms - waited)));
+        }
+        return stopRequested();
+    }
+
+private:
+    std::shared_ptr<std::atomic<bool>> flag_;
+};
+
+/*
+* 进度回调, stage 为当前阶段的名称(字符串字面量), done/total 为已完成及总的数量,
+* total 为 0 时表示数量未知. 可能在工作线程中调用
+*/
+using ProgressCallback = std::function<void(const char *stage, int done, int total)>;
+
+#endif  // STOP_TOKEN_H
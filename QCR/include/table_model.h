@@ -0,0 +1,110 @@
+﻿#ifndef TABLE_MODEL_H
+#define TABLE_MODEL_H
+
+#include <opencv2/core/types.hpp>
+#include <nlohmann/json.hpp>
+using json = nlohmann::json;
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 单元格的外接矩形, 由多边形顶点预先计算得到
+struct CellRect
+{
+    int left = 0;
+    int top = 0;
+    int right = 0;
+    int bottom = 0;
+};
+
+/*
+* 表格识别结果. 单元格的各项属性分别连续存放(结构数组), 文本统一存放在一块
+* 字符串缓冲区中, 同时维护以左上角行列为下标的稠密索引, 可以 O(1) 地定位单元格.
+* 只在与 json 相互转换时才涉及 json, json 格式为:
+* {
+*   "[row]": {
+*     "[col]": {
+*       "row_span": 1,
+*       "col_span": 1,
+*       "text": "text",
+*       "polygon": [[x1, y1],[x2,y2],[x3,y3],[x4,y4]]
+*     }
+*   }
+* }
+*/
+class TableModel
+{
+public:
+    using Polygon = std::array<cv::Point, 4>;
+    static constexpr int npos = -1;
+
+    TableModel() = default;
+    // 复制时只复制各单元格当前的文本, 不复制被 setText 替换掉的旧文本
+    TableModel(const TableModel &other);
+    TableModel &operator=(const TableModel &other);
+    TableModel(TableModel &&other) = default;
+    TableModel &operator=(TableModel &&other) = default;
+
+    void clear();
+    bool empty() const { return rows_.empty(); }
+    // 单元格数量
+    int size() const { return static_cast<int>(rows_.size()); }
+    // 表格行数, 包括跨行单元格占据的行
+    int rowCount() const { return row_count_; }
+    // 表格列数, 包括跨列单元格占据的列
+    int columnCount() const { return col_count_; }
+
+    /*
+    * @brief 添加单元格, 左上角位置已存在单元格时覆盖原单元格
+    * @param polygon 单元格四个顶点的像素坐标
+    * @return 单元格的索引
+    */
+    int addCell(int row, int col, int row_span, int col_span,
+        const std::string &text, const Polygon &polygon);
+
+    /*
+    * @brief 查找左上角位于(row, col)的单元格
+    * @return 单元格索引, 不存在时返回 npos
+    */
+    int find(int row, int col) const;
+
+    int row(int i) const { return rows_[i]; }
+    int col(int i) const { return cols_[i]; }
+    int rowSpan(int i) const { return row_spans_[i]; }
+    int colSpan(int i) const { return col_spans_[i]; }
+    const CellRect &rect(int i) const { return rects_[i]; }
+    const Polygon &polygon(int i) const { return polygons_[i]; }
+    std::string_view text(int i) const;
+    void setText(int i, const std::string &text);
+    // 整理文本缓冲区, 去掉 setText 追加新文本后遗留的旧文本
+    void compact();
+
+    static TableModel fromJson(const json &data);
+    json toJson() const;
+
+private:
+    // 保证索引能容纳(rows, cols)大小的表格
+    void reserveIndex(int rows, int cols);
+
+    std::vector<int> rows_;
+    std::vector<int> cols_;
+    std::vector<int> row_spans_;
+    std::vector<int> col_spans_;
+    std::vector<uint32_t> text_offsets_;
+    std::vector<uint32_t> text_lengths_;
+    std::vector<CellRect> rects_;
+    std::vector<Polygon> polygons_;
+    std::string text_pool_;  // 所有单元格的文本
+
+    // 稠密索引, index_[row * index_stride_ + col] 为左上角位于该处的单元格
+    std::vector<int> index_;
+    int index_rows_ = 0;
+    int index_stride_ = 0;
+    int row_count_ = 0;
+    int col_count_ = 0;
+};
+
+#endif // TABLE_MODEL_H
@@ -0,0 +1,41 @@
+﻿/*
+* 只把需要云端识别的文字区域发送给通用文字识别接口. 本地识别或模板匹配得到表格结构后,
+* 姓名、学号等单元格仍需识别文字, 而分数由本地的数字识别得到, 不需要也不应该发送出去.
+* 除指定单元格以外的区域涂白后裁剪为一张图片, 只调用一次接口,
+* 返回的文本行按中心点落在哪个单元格写回表格.
+*/
+
+#ifndef TEXT_CROPS_H
+#define TEXT_CROPS_H
+
+#include <opencv2/core.hpp>
+
+#include <string>
+#include <vector>
+
+#include "include/table_model.h"
+
+// 通用文字识别返回的一行文本, 坐标相对于发送的图片
+struct TextLine
+{
+    std::string text;
+    cv::Rect box;
+};
+
+/*
+* @brief 生成只包含指定单元格的图片, 其余区域涂白后裁剪到这些单元格的外接矩形
+* @param offset 裁剪区域左上角在原图中的坐标
+* @return cells 为空时返回空图片
+*/
+cv::Mat maskTextCells(const cv::Mat &img, const TableModel &model, const std::vector<int> &cells,
+    cv::Point &offset);
+
+/*
+* @brief 将文本行按中心点写入所在的单元格, 同一单元格的多行按从上到下、从左到右拼接
+* @param offset maskTextCells 给出的裁剪区域左上角
+* @return 写入文本的单元格数量
+*/
+int fillCellText(TableModel &model, const std::vector<int> &cells, std::vector<TextLine> lines,
+    cv::Point offset);
+
+#endif // TEXT_CROPS_H
@@ -0,0 +1,77 @@
+﻿/*
+* 各处理阶段的耗时追踪. 在需要统计的作用域开头声明 TRACE_SCOPE("name"),
+* 作用域结束时记录一个时间段. 每个线程有自己的环形缓冲区, 记录时不加锁,
+* 缓冲区写满后覆盖最早的记录, 线程结束后缓冲区由新线程复用. 结果导出为 Chrome trace json 格式,
+* 可以在 chrome://tracing 或 https://ui.perfetto.dev 中查看.
+*
+* 默认关闭, 关闭时每个 TRACE_SCOPE 只有一次原子变量读取.
+* 设置环境变量 QCR_TRACE=文件路径 后启用, 程序退出时写入该文件.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+extern std::atomic<bool> trace_enabled;
+
+// 当前时间, 从程序启动开始计算的纳秒数
+int64_t traceNow();
+
+/*
+* @brief 记录一个时间段
+* @param name 名称, 必须是字符串字面量等生命周期与程序相同的字符串
+* @param arg 附加的整数参数(如列号), 小于0时不导出
+*/
+void traceRecord(const char *name, int64_t begin, int64_t end, int arg);
+
+void setTraceEnabled(bool enabled);
+
+inline bool traceEnabled()
+{
+    return trace_enabled.load(std::memory_order_relaxed);
+}
+
+/*
+* @brief 将所有线程的记录导出为 Chrome trace json, 应在各线程空闲时调用
+* @return 写入文件失败时返回false
+*/
+bool exportTrace(const std::string &path);
+
+/*
+* @brief 读取环境变量 QCR_TRACE, 设置时启用追踪, 由 finishTrace 写入该文件
+*/
+void initTrace();
+
+void finishTrace();
+
+// 作用域内的时间段, 构造时记录开始时间, 析构时写入缓冲区
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name, int arg = -1)
+        : name_(traceEnabled() ? name : nullptr), arg_(arg), begin_(name_ ? traceNow() : 0)
+    {
+    }
+    ~TraceSpan()
+    {
+        if (name_)
+            traceRecord(name_, begin_, traceNow(), arg_);
+    }
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const char *name_;
+    int arg_;
+    int64_t begin_;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+// TRACE_SCOPE("name") 或 TRACE_SCOPE("name", arg)
+#define TRACE_SCOPE(...) TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(__VA_ARGS__)
+
+#endif // TRACE_H
@@ -1,4 +1,9 @@
 ﻿#include <string>
+#include <vector>
+
+#include "include/table_model.h"
+#include "include/stop_token.h"
+#include "include/text_crops.h"
 
 /*
 * @brief 获取腾讯Authorization
@@ -18,8 +23,33 @@ static size_t txGetResponse(void *ptr, size_t size, size_t nmemb, void *stream);
 * @param secret_id
 * @param secret_key
 * @param base64_image Base64编码的图片
+* @param token 请求停止时中止传输
 * @return 成功返回0, 否则失败
 */
 int txFormOcrRequest(std::string &json_result, const std::string &request_url,
     const std::string &secret_id, const std::string &secret_key,
-    const std::string &base64_image);
+    const std::string &base64_image, const StopToken &token = StopToken());
+
+/*
+* @brief 发送POST请求调用通用印刷体识别(GeneralBasicOCR), 参数同 txFormOcrRequest.
+*  用于识别 maskTextCells 生成的只包含文字单元格的图片
+*/
+int txGeneralOcrRequest(std::string &json_result, const std::string &request_url,
+    const std::string &secret_id, const std::string &secret_key,
+    const std::string &base64_image, const StopToken &token = StopToken());
+
+/*
+* @brief 流式解析腾讯通用印刷体识别的返回数据, 得到各文本行及其位置
+* @return 成功返回true, 数据格式错误或接口返回错误时返回false
+*/
+bool txParseText(const std::string &str, std::vector<TextLine> &lines, std::string &error);
+
+/*
+* @brief 流式解析腾讯表格识别的返回数据, 不构建 json 对象, 单元格直接写入 model.
+*  返回多个表格时选取单元格最多的一个
+* @param str 返回的json格式字符串
+* @param model 识别结果, 没有识别到表格时为空
+* @param error 失败时的错误信息
+* @return 成功返回true, 数据格式错误或接口返回错误时返回false
+*/
+bool txParseTable(const std::string &str, TableModel &model, std::string &error);
@@ -0,0 +1,118 @@
+﻿/*
+* 多张表格的工作区. 每张表格(Sheet)保存各自的图片、对图片的操作、截取框及识别结果,
+* 切换表格时不再丢弃之前的状态. 后台任务只在完成回调(界面线程)中修改 Sheet,
+* 因此 Workspace 只在界面线程中使用, 不加锁.
+*
+* 图片内存超过预算时, 释放已完成识别的表格的全分辨率图片, 只保留识别结果.
+* 之后再次查看时从文件重新加载, 并按 ops 依次重做旋转和校正得到相同的图片.
+* PDF 及多页 TIFF 的每一页作为一张表格, 重新加载时只读取对应的一页.
+*/
+
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include <QString>
+
+#include <opencv2/core.hpp>
+
+#include <memory>
+#include <vector>
+
+#include "include/table_model.h"
+
+// 图片内存的默认预算(MB)
+constexpr size_t SHEET_MEMORY_BUDGET_MB = 1024;
+
+// 对原图执行的一次操作
+struct SheetOp
+{
+    enum Type
+    {
+        ROTATE,  // 顺时针旋转90度
+        WARP,    // 按四个顶点透视校正
+    };
+    Type type;
+    std::vector<std::vector<double>> points;  // WARP 的四个顶点, 相对坐标
+};
+
+// 对原图依次执行 ops, 得到校正后的图片
+cv::Mat applySheetOps(const cv::Mat &src, const std::vector<SheetOp> &ops);
+
+/*
+* @brief 读取图片, 宽高超过 len 像素或文件超过 sz MB 时按比例缩小并覆盖原文件
+* @return 读取失败时返回空图片
+*/
+cv::Mat loadSheetImage(const QString &path, int len, int sz);
+
+struct Sheet
+{
+    enum Status
+    {
+        PENDING,      // 等待加载
+        READY,        // 已加载, 未识别
+        RECOGNIZING,  // 识别中
+        RECOGNIZED,   // 已识别
+        OPTIMIZED,    // 已优化
+        FAILED,       // 加载或识别失败
+    };
+
+    int id = 0;
+    QString path;
+    int page = -1;            // 多页文档中的页码, 从0开始; 单张图片为-1
+    Status status = PENDING;
+    bool loading = false;     // 正在(重新)加载图片
+    bool batch = false;       // 批量处理中: 加载后自动校正并识别, 识别结束前占用一个预读名额
+
+    cv::Mat src_img;          // 缩放后的原图, 可能被释放
+    cv::Mat cropped_img;      // 后续处理都对该图进行处理, 可能被释放
+    std::vector<SheetOp> ops; // 从 src_img 得到 cropped_img 的操作
+    std::vector<std::vector<double>> box;  // 截取框, 相对于 cropped_img
+
+    // 识别结果. 当前显示的表格以界面中的结果为准, 切换到其他表格时写回
+    TableModel result;
+    // 本地识别或版式模板给出的纯数字列, 为空时根据文本内容判断分数列
+    std::vector<int> digit_columns;
+    int score_row = 0;  // 本地识别给出的分数区域首行, 以上为表头
+
+    quint64 image_generation = 0;  // 图片改变时递增, 完成时序号已改变的识别结果将被丢弃
+    quint64 table_generation = 0;  // result 被替换时递增, 完成时序号已改变的优化结果将被丢弃
+
+    bool loaded() const { return !src_img.empty(); }
+    // 全分辨率图片占用的内存, 共享数据的图片只计算一次
+    size_t imageBytes() const;
+    // 文件名, 多页文档附加页码
+    QString name() const;
+    // 轮廓识别结果缓存的键, 由表格编号及 image_generation 组成, 图片未改变时不变
+    QString contourKey() const;
+    // 列表中显示的名称及状态
+    QString displayText() const;
+};
+
+class Workspace
+{
+public:
+    explicit Workspace(size_t budget_mb = SHEET_MEMORY_BUDGET_MB);
+
+    Sheet &add(const QString &path);
+    // 不存在时返回 nullptr
+    Sheet *find(int id);
+    // 在列表中的位置, 不存在时返回-1
+    int indexOf(int id) const;
+    int count() const { return static_cast<int>(sheets_.size()); }
+    Sheet &at(int index) { return *sheets_[index]; }
+
+    size_t imageBytes() const;
+    /*
+    * @brief 图片内存超过预算时, 按打开顺序释放已完成识别的表格的图片
+    * @param keep 当前显示的表格, 不释放
+    * @return 被释放的表格
+    */
+    std::vector<int> evict(int keep);
+
+private:
+    std::vector<std::unique_ptr<Sheet>> sheets_;
+    int next_id_ = 1;
+    size_t budget_;
+};
+
+#endif  // WORKSPACE_H
@@ -1,7 +1,14 @@
 ﻿#include <curl/curl.h>
 
+#include <algorithm>
+#include <climits>
+
 #include "include/bd_ocr.h"
 #include "include/helper.h"
+#include "include/json_sax.h"
+#include "include/cell_text.h"
+#include "include/trace.h"
+#include "include/metrics.h"
 
 static size_t bdGetResponse(void *ptr, size_t sz, size_t nmemb, void *stream)
 {
@@ -10,6 +17,12 @@ static size_t bdGetResponse(void *ptr, size_t sz, size_t nmemb, void *stream)
     return sz * nmemb;
 }
 
+// curl 进度回调, 请求停止时返回非0以中止传输
+static int bdProgress(void *clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+{
+    return static_cast<const StopToken *>(clientp)->stopRequested() ? 1 : 0;
+}
+
 int bdGetAccessToken(std::string &access_token, const std::string &access_token_url,
     const std::string &api_key, const std::string &secret_key)
 {
@@ -28,9 +41,18 @@ int bdGetAccessToken(std::string &access_token, const std::string &access_token_
         curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0);
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, &access_token);
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, bdGetResponse);
-        result_code = curl_easy_perform(curl);
+        {
+            static Histogram &latency = metrics().histogram("qcr_ocr_request_seconds",
+                "OCR service request latency", "provider=\"bd\",endpoint=\"token\"");
+            TRACE_SCOPE("bd token http");
+            ScopedTimer timer(latency);
+            result_code = curl_easy_perform(curl);
+        }
         if (result_code != CURLE_OK)
         {
+            static Counter &failures = metrics().counter("qcr_ocr_request_failures_total",
+                "Failed OCR service requests", "provider=\"bd\",endpoint=\"token\"");
+            failures.inc();
             printLog(QString("[bd] curl_easy_perform() failed: %1")
                 .arg(curl_easy_strerror(result_code)));
             return 1;
@@ -47,7 +69,7 @@ int bdGetAccessToken(std::string &access_token, const std::string &access_token_
 }
 
 int bdFormOcrRequest(std::string &json_result, const std::string &request_url,
-    const std::string &access_token, const std::string &base64_image)
+    const std::string &access_token, const std::string &base64_image, const StopToken &token)
 {
     json_result.clear();
     std::string url = request_url + "?access_token=" + access_token;
@@ -71,9 +93,28 @@ int bdFormOcrRequest(std::string &json_result, const std::string &request_url,
         // 设置回调用于写入收到的数据
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, &json_result);
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, bdGetResponse);
-        result_code = curl_easy_perform(curl);
+        // 设置回调用于取消请求
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, bdProgress);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, const_cast<StopToken *>(&token));
+        {
+            static Histogram &latency = metrics().histogram("qcr_ocr_request_seconds",
+                "OCR service request latency", "provider=\"bd\",endpoint=\"request\"");
+            TRACE_SCOPE("bd request http");
+            ScopedTimer timer(latency);
+            result_code = curl_easy_perform(curl);
+        }
+        if (result_code == CURLE_ABORTED_BY_CALLBACK)
+        {
+            printLog("[bd] request cancelled");
+            curl_easy_cleanup(curl);
+            return 1;
+        }
         if (result_code != CURLE_OK)
         {
+            static Counter &failures = metrics().counter("qcr_ocr_request_failures_total",
+                "Failed OCR service requests", "provider=\"bd\",endpoint=\"request\"");
+            failures.inc();
             printLog(QString("[bd] curl_easy_perform() failed: %1")
                 .arg(curl_easy_strerror(result_code)));
             is_success = 1;
@@ -92,7 +133,7 @@ int bdFormOcrRequest(std::string &json_result, const std::string &request_url,
 
 int bdGetResult(std::string &json_result, const std::string &request_url,
     const std::string &access_token, const std::string &request_id,
-    const std::string &result_type)
+    const std::string &result_type, const StopToken &token)
 {
     json_result.clear();
     std::string url = request_url + "?access_token=" + access_token;
@@ -118,9 +159,28 @@ int bdGetResult(std::string &json_result, const std::string &request_url,
         // 设置回调用于写入收到的数据
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, &json_result);
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, bdGetResponse);
-        result_code = curl_easy_perform(curl);
+        // 设置回调用于取消请求
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, bdProgress);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, const_cast<StopToken *>(&token));
+        {
+            static Histogram &latency = metrics().histogram("qcr_ocr_request_seconds",
+                "OCR service request latency", "provider=\"bd\",endpoint=\"result\"");
+            TRACE_SCOPE("bd result http");
+            ScopedTimer timer(latency);
+            result_code = curl_easy_perform(curl);
+        }
+        if (result_code == CURLE_ABORTED_BY_CALLBACK)
+        {
+            printLog("[bd] request cancelled");
+            curl_easy_cleanup(curl);
+            return 1;
+        }
         if (result_code != CURLE_OK)
         {
+            static Counter &failures = metrics().counter("qcr_ocr_request_failures_total",
+                "Failed OCR service requests", "provider=\"bd\",endpoint=\"result\"");
+            failures.inc();
             printLog(QString("[bd] curl_easy_perform() failed: %1")
                 .arg(curl_easy_strerror(result_code)));
             is_success = 1;
@@ -136,3 +196,256 @@ int bdGetResult(std::string &json_result, const std::string &request_url,
     }
     return is_success;
 }
+
+namespace
+{
+
+// 请求接口的返回数据只取出 result[0].request_id
+class BdRequestSax : public PathSax
+{
+public:
+    std::string request_id;
+    std::string api_error;  // error_msg
+
+protected:
+    void onString(std::string &val) override
+    {
+        if (name() == "request_id" && request_id.empty() && match({ "result", "[]" }))
+            request_id.swap(val);
+        else if (name() == "error_msg" && match({}))
+            api_error.swap(val);
+    }
+};
+
+// 外层数据只取出任务状态 result.ret_code 及 result.result_data 字符串
+class BdResponseSax : public PathSax
+{
+public:
+    int ret_code = -1;
+    std::string result_data;
+    std::string api_error;  // error_msg
+
+protected:
+    void onNumber(double val) override
+    {
+        if (name() == "ret_code" && match({ "result" }))
+            ret_code = static_cast<int>(val);
+    }
+
+    void onString(std::string &val) override
+    {
+        if (name() == "result_data" && match({ "result" }))
+            result_data.swap(val);
+        else if (name() == "error_msg" && match({}))
+            api_error.swap(val);
+    }
+};
+
+// result_data 中 forms[0].body[] 的单元格依次写入表格
+class BdTableSax : public PathSax
+{
+public:
+    TableModel table;
+
+protected:
+    void onStart(bool array) override
+    {
+        if (!array && !form_done_ && match({ "forms", "[]", "body", "[]" }))
+            cell_ = Cell();
+    }
+
+    void onEnd(bool array) override
+    {
+        if (array || form_done_)
+            return;
+        if (match({ "forms", "[]", "body", "[]" }))
+            addCell();
+        else if (match({ "forms", "[]" }))
+            form_done_ = true;
+    }
+
+    void onNumber(double val) override
+    {
+        if (form_done_)
+            return;
+        int v = static_cast<int>(val);
+        if (match({ "forms", "[]", "body", "[]", "row" }))
+        {
+            cell_.row_min = std::min(cell_.row_min, v);
+            cell_.row_max = std::max(cell_.row_max, v);
+        }
+        else if (match({ "forms", "[]", "body", "[]", "column" }))
+        {
+            cell_.col_min = std::min(cell_.col_min, v);
+            cell_.col_max = std::max(cell_.col_max, v);
+        }
+        else if (match({ "forms", "[]", "body", "[]", "rect" }))
+        {
+            const std::string &key = name();
+            if (key == "left")
+                cell_.left = v;
+            else if (key == "top")
+                cell_.top = v;
+            else if (key == "width")
+                cell_.width = v;
+            else if (key == "height")
+                cell_.height = v;
+        }
+    }
+
+    void onString(std::string &val) override
+    {
+        if (!form_done_ && name() == "word" && match({ "forms", "[]", "body", "[]" }))
+            cell_.word.swap(val);
+    }
+
+private:
+    struct Cell
+    {
+        // 占据的行列范围, 从1开始
+        int row_min = INT_MAX;
+        int row_max = INT_MIN;
+        int col_min = INT_MAX;
+        int col_max = INT_MIN;
+        int left = 0;
+        int top = 0;
+        int width = 0;
+        int height = 0;
+        std::string word;
+    };
+
+    void addCell()
+    {
+        if (cell_.row_min > cell_.row_max || cell_.col_min > cell_.col_max)
+            return;
+        // 最小值作为该格子的左上角单元格坐标
+        int row = cell_.row_min - 1;
+        int col = cell_.col_min - 1;
+        int right = cell_.left + cell_.width;
+        int bottom = cell_.top + cell_.height;
+        TableModel::Polygon polygon = {
+            cv::Point(cell_.left, cell_.top), cv::Point(right, cell_.top),
+            cv::Point(right, bottom), cv::Point(cell_.left, bottom) };
+        table.addCell(row, col, cell_.row_max - row, cell_.col_max - col,
+            cleanCellText(cell_.word), polygon);
+    }
+
+    Cell cell_;
+    bool form_done_ = false;
+};
+
+// words_result[] 中的文本行
+class BdTextSax : public PathSax
+{
+public:
+    std::vector<TextLine> lines;
+    std::string api_error;  // error_msg
+
+protected:
+    void onStart(bool array) override
+    {
+        if (!array && match({ "words_result", "[]" }))
+            line_ = TextLine();
+    }
+
+    void onEnd(bool array) override
+    {
+        if (!array && match({ "words_result", "[]" }))
+            lines.push_back(std::move(line_));
+    }
+
+    void onNumber(double val) override
+    {
+        if (!match({ "words_result", "[]", "location" }))
+            return;
+        const std::string &key = name();
+        int v = static_cast<int>(val);
+        if (key == "left")
+            line_.box.x = v;
+        else if (key == "top")
+            line_.box.y = v;
+        else if (key == "width")
+            line_.box.width = v;
+        else if (key == "height")
+            line_.box.height = v;
+    }
+
+    void onString(std::string &val) override
+    {
+        if (name() == "words" && match({ "words_result", "[]" }))
+            line_.text.swap(val);
+        else if (name() == "error_msg" && match({}))
+            api_error.swap(val);
+    }
+
+private:
+    TextLine line_;
+};
+
+}  // namespace
+
+bool bdParseText(const std::string &str, std::vector<TextLine> &lines, std::string &error)
+{
+    BdTextSax sax;
+    if (!json::sax_parse(str, &sax))
+    {
+        error = sax.error();
+        return false;
+    }
+    if (!sax.api_error.empty())
+    {
+        error = sax.api_error;
+        return false;
+    }
+    lines = std::move(sax.lines);
+    return true;
+}
+
+bool bdParseRequestId(const std::string &str, std::string &request_id, std::string &error)
+{
+    BdRequestSax sax;
+    if (!json::sax_parse(str, &sax))
+    {
+        error = sax.error();
+        return false;
+    }
+    if (sax.request_id.empty())
+    {
+        error = sax.api_error.empty() ? "missing request_id" : sax.api_error;
+        return false;
+    }
+    request_id = std::move(sax.request_id);
+    return true;
+}
+
+bool bdParseTable(const std::string &str, TableModel &model, std::string &error, int *ret_code)
+{
+    BdResponseSax response;
+    if (!json::sax_parse(str, &response))
+    {
+        error = response.error();
+        return false;
+    }
+    if (ret_code)
+        *ret_code = response.ret_code;
+    if (response.ret_code >= 0 && response.ret_code != 3)
+    {
+        error = "task not finished";
+        return false;
+    }
+    if (response.result_data.empty())
+    {
+        error = response.api_error.empty() ? "missing result_data" : response.api_error;
+        return false;
+    }
+
+    // result_data 是内嵌的json字符串
+    BdTableSax sax;
+    if (!json::sax_parse(response.result_data, &sax))
+    {
+        error = sax.error();
+        return false;
+    }
+    model = std::move(sax.table);
+    return true;
+}
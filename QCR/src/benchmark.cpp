@@ -0,0 +1,1227 @@
+﻿#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QStringList>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <nlohmann/json.hpp>
+using json = nlohmann::json;
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <random>
+#include <thread>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "include/benchmark.h"
+#include "include/cell_index.h"
+#include "include/cell_text.h"
+#include "include/edge_detection.h"
+#include "include/helper.h"
+#include "include/morphology.h"
+#include "include/bd_ocr.h"
+#include "include/digits_classify.h"
+#include "include/local_grid.h"
+#include "include/pipeline.h"
+#include "include/tx_ocr.h"
+
+namespace
+{
+
+// 返回 func 执行 repeat 次的平均耗时(ms)
+template <typename F>
+double timeIt(F &&func, int repeat)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeat; ++i)
+        func();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / repeat;
+}
+
+// 命令行参数, "--key value" 形式的为选项, 其余为位置参数
+struct BenchArgs
+{
+    QStringList positional;
+    std::map<std::string, QString> options;
+
+    QString option(const std::string &key, const QString &def) const
+    {
+        auto it = options.find(key);
+        return it == options.end() ? def : it->second;
+    }
+
+    int intOption(const std::string &key, int def) const
+    {
+        bool ok = false;
+        int val = option(key, QString()).toInt(&ok);
+        return ok ? val : def;
+    }
+
+    // 逗号分隔的整数列表, 如 "--min-height 10,12,14"
+    std::vector<int> intList(const std::string &key, int def) const
+    {
+        std::vector<int> vals;
+        for (const QString &item : option(key, QString()).split(',', Qt::SkipEmptyParts))
+        {
+            bool ok = false;
+            int val = item.trimmed().toInt(&ok);
+            if (ok)
+                vals.push_back(val);
+        }
+        if (vals.empty())
+            vals.push_back(def);
+        return vals;
+    }
+};
+
+// argv[0] 为测试名称, 从 argv[1] 开始解析
+BenchArgs parseArgs(int argc, char *argv[])
+{
+    BenchArgs args;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) == 0 && i + 1 < argc)
+            args.options[arg.substr(2)] = QString::fromLocal8Bit(argv[++i]);
+        else
+            args.positional.append(QString::fromLocal8Bit(argv[i]));
+    }
+    return args;
+}
+
+// 列出目录下的所有图片, 按文件名排序
+QStringList listImages(const QString &dir)
+{
+    QStringList files;
+    QDir d(dir);
+    QFileInfoList ls = d.entryInfoList(
+        QStringList({ "*.jpg", "*.JPG", "*.jpeg", "*.png", "*.bmp", "*.tiff" }),
+        QDir::Files, QDir::Name);
+    for (auto &info : ls)
+        files.append(info.absoluteFilePath());
+    return files;
+}
+
+// 列出所有目录下的图片, 未指定目录时使用 test
+QStringList listImages(const QStringList &dirs)
+{
+    QStringList files;
+    for (const QString &dir : dirs.isEmpty() ? QStringList({ "test" }) : dirs)
+        files += listImages(dir);
+    return files;
+}
+
+bool saveResult(const json &result, const QString &path)
+{
+    std::ofstream out(path.toLocal8Bit().data());
+    if (!out)
+    {
+        printLog(QString::fromUtf8(u8"无法写入测试结果: %1").arg(path));
+        return false;
+    }
+    out << result.dump(2);
+    printLog(QString::fromUtf8(u8"测试结果已写入: %1").arg(path));
+    return true;
+}
+
+// 与 removeTableBorders 相同的预处理, 得到形态学运算的输入
+cv::Mat binarize(const cv::Mat &img)
+{
+    cv::Mat gray = img;
+    if (img.channels() == 3)
+        cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
+    cv::Mat blured;
+    cv::bilateralFilter(gray, blured, 5, 70, 70);
+    cv::Mat proc;
+    cv::createCLAHE(1, cv::Size(10, 10))->apply(blured, proc);
+    cv::Mat bin;
+    cv::adaptiveThreshold(proc, bin, 255,
+        cv::ADAPTIVE_THRESH_GAUSSIAN_C, cv::THRESH_BINARY_INV, 15, 10);
+    return bin;
+}
+
+int benchMorphology(int argc, char *argv[])
+{
+    BenchArgs args = parseArgs(argc, argv);
+    QString out = args.option("out", "bench_morphology.json");
+    const int repeat = args.intOption("repeat", 5);
+    const int lens[] = { 30, 40, 80, 160 };
+
+    json result = { {"benchmark", "morphology"}, {"repeat", repeat}, {"images", json::array()} };
+    for (const QString &path : listImages(args.positional))
+    {
+        cv::Mat img = cv::imread(path.toLocal8Bit().data());
+        if (img.empty())
+            continue;
+        cv::Mat bin = binarize(img);
+
+        json item = { {"file", QFileInfo(path).fileName().toUtf8().data()},
+            {"width", bin.cols}, {"height", bin.rows}, {"cases", json::array()} };
+        for (int len : lens)
+        {
+            for (bool horizontal : { true, false })
+            {
+                cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT,
+                    horizontal ? cv::Size(len, 1) : cv::Size(1, len));
+                cv::Mat cv_out;
+                cv::Mat vhgw_out;
+                // 与 removeTableBorders 一致: 腐蚀、膨胀各迭代2次
+                double t_cv = timeIt([&]() {
+                    cv::erode(bin, cv_out, kernel, cv::Point(-1, -1), 2);
+                    cv::dilate(cv_out, cv_out, kernel, cv::Point(-1, -1), 2);
+                    }, repeat);
+                double t_vhgw = timeIt([&]() {
+                    erodeLine(bin, vhgw_out, len, horizontal, 2);
+                    dilateLine(vhgw_out, vhgw_out, len, horizontal, 2);
+                    }, repeat);
+                bool same = cv::countNonZero(cv_out != vhgw_out) == 0;
+
+                item["cases"].push_back({ {"len", len}, {"horizontal", horizontal},
+                    {"opencv_ms", t_cv}, {"vhgw_ms", t_vhgw}, {"identical", same} });
+                printLog(QString("[morphology] %1 len=%2 %3: opencv %4 ms, vhgw %5 ms%6")
+                    .arg(QFileInfo(path).fileName()).arg(len).arg(horizontal ? "h" : "v")
+                    .arg(t_cv, 0, 'f', 2).arg(t_vhgw, 0, 'f', 2).arg(same ? "" : " MISMATCH"));
+            }
+        }
+        result["images"].push_back(item);
+    }
+    return saveResult(result, out) ? 0 : 1;
+}
+
+// 读取图片同名的标注文件 xxx.quad.json 中的四个顶点像素坐标
+bool loadQuadAnnotation(const QString &image_path, std::vector<cv::Point2d> &corners)
+{
+    QFileInfo info(image_path);
+    QString path = info.absolutePath() + "/" + info.completeBaseName() + ".quad.json";
+    std::ifstream in(path.toLocal8Bit().data());
+    if (!in)
+        return false;
+    json data = json::parse(in, nullptr, false);
+    if (data.is_discarded() || !data.contains("corners") || data.at("corners").size() != 4)
+    {
+        printLog(QString::fromUtf8(u8"标注文件格式错误: %1").arg(path));
+        return false;
+    }
+    corners.clear();
+    for (const auto &p : data.at("corners"))
+        corners.push_back(cv::Point2d(p.at(0).get<double>(), p.at(1).get<double>()));
+    return true;
+}
+
+json timingsToJson(const ContourTimings &t)
+{
+    return { {"resize", t.resize}, {"bilateral", t.bilateral}, {"canny", t.canny},
+        {"contours", t.contours}, {"hough", t.hough}, {"vertex", t.vertex}, {"total", t.total} };
+}
+
+int benchContour(int argc, char *argv[])
+{
+    BenchArgs args = parseArgs(argc, argv);
+    QString out = args.option("out", "bench_contour.json");
+    const int repeat = args.intOption("repeat", 3);
+    const int len = args.intOption("len", 1000);
+
+    json result = { {"benchmark", "contour"}, {"repeat", repeat}, {"len", len},
+        {"images", json::array()} };
+    ContourTimings sum;
+    int detected = 0;
+    int annotated = 0;
+    int measured = 0;   // 有标注且检测到, 参与误差统计
+    int missed = 0;     // 有标注但未检测到
+    double err_sum = 0;
+    QStringList images = listImages(args.positional);
+    for (const QString &path : images)
+    {
+        cv::Mat img = cv::imread(path.toLocal8Bit().data());
+        if (img.empty())
+            continue;
+
+        // 多次运行取各阶段的平均耗时
+        std::vector<std::vector<double>> points_rel;
+        ContourTimings avg;
+        bool ok = false;
+        for (int i = 0; i < repeat; ++i)
+        {
+            ContourTimings t;
+            ok = detectContour(img, points_rel, len, &t);
+            avg.resize += t.resize / repeat;
+            avg.bilateral += t.bilateral / repeat;
+            avg.canny += t.canny / repeat;
+            avg.contours += t.contours / repeat;
+            avg.hough += t.hough / repeat;
+            avg.vertex += t.vertex / repeat;
+            avg.total += t.total / repeat;
+        }
+        sum.resize += avg.resize;
+        sum.bilateral += avg.bilateral;
+        sum.canny += avg.canny;
+        sum.contours += avg.contours;
+        sum.hough += avg.hough;
+        sum.vertex += avg.vertex;
+        sum.total += avg.total;
+
+        json item = { {"file", QFileInfo(path).fileName().toUtf8().data()},
+            {"width", img.cols}, {"height", img.rows}, {"detected", ok},
+            {"timings_ms", timingsToJson(avg)} };
+        std::vector<cv::Point2d> corners;
+        if (ok)
+        {
+            ++detected;
+            for (const auto &p : points_rel)
+                corners.push_back(cv::Point2d(p[0] * img.cols, p[1] * img.rows));
+            json pts = json::array();
+            for (const auto &p : corners)
+                pts.push_back({ p.x, p.y });
+            item["corners"] = pts;
+        }
+
+        // 与标注比较, 误差为对应顶点的像素距离
+        std::vector<cv::Point2d> truth;
+        if (loadQuadAnnotation(path, truth))
+        {
+            ++annotated;
+            double diag = std::hypot(img.cols, img.rows);
+            if (ok)
+            {
+                double mean = 0;
+                double max = 0;
+                for (int i = 0; i < 4; ++i)
+                {
+                    double d = cv::norm(corners[i] - truth[i]);
+                    mean += d / 4;
+                    max = std::max(max, d);
+                }
+                err_sum += mean;
+                ++measured;
+                item["error"] = { {"mean_px", mean}, {"max_px", max},
+                    {"max_rel_diag", max / diag} };
+            }
+            else
+            {
+                ++missed;
+            }
+        }
+        result["images"].push_back(item);
+        printLog(QString("[contour] %1: %2, %3 ms")
+            .arg(QFileInfo(path).fileName()).arg(ok ? "ok" : "failed").arg(avg.total, 0, 'f', 2));
+    }
+
+    int n = std::max(1, static_cast<int>(result["images"].size()));
+    ContourTimings mean;
+    mean.resize = sum.resize / n;
+    mean.bilateral = sum.bilateral / n;
+    mean.canny = sum.canny / n;
+    mean.contours = sum.contours / n;
+    mean.hough = sum.hough / n;
+    mean.vertex = sum.vertex / n;
+    mean.total = sum.total / n;
+    result["summary"] = { {"images", result["images"].size()}, {"detected", detected},
+        {"annotated", annotated}, {"annotated_missed", missed}, {"mean_timings_ms", timingsToJson(mean)} };
+    // 误差只在检测到且有标注的图片上平均, 有标注但未检测到的单独计数
+    if (measured > 0)
+        result["summary"]["mean_error_px"] = err_sum / measured;
+    return saveResult(result, out) ? 0 : 1;
+}
+
+// 生成 rows×cols 的合成表格, 单元格尺寸带随机抖动, 部分单元格跨行或跨列
+TableModel syntheticTable(int rows, int cols, std::mt19937 &rng)
+{
+    const int cell_w = 80;
+    const int cell_h = 30;
+    std::uniform_int_distribution<int> jitter(-3, 3);
+    std::uniform_int_distribution<int> span(0, 19);
+
+    TableModel model;
+    std::vector<char> covered(static_cast<size_t>(rows) * cols, 0);
+    for (int i = 0; i < rows; ++i)
+    {
+        for (int j = 0; j < cols; ++j)
+        {
+            if (covered[static_cast<size_t>(i) * cols + j])
+                continue;
+            int row_span = (span(rng) == 0 && i + 1 < rows) ? 2 : 1;
+            int col_span = (span(rng) == 0 && j + 1 < cols) ? 2 : 1;
+            for (int r = i; r < i + row_span; ++r)
+                for (int c = j; c < j + col_span; ++c)
+                    covered[static_cast<size_t>(r) * cols + c] = 1;
+
+            int l = j * cell_w + jitter(rng);
+            int t = i * cell_h + jitter(rng);
+            int r = (j + col_span) * cell_w + jitter(rng);
+            int b = (i + row_span) * cell_h + jitter(rng);
+            TableModel::Polygon polygon = {
+                cv::Point(l, t), cv::Point(r, t), cv::Point(r, b), cv::Point(l, b) };
+            model.addCell(i, j, row_span, col_span, "", polygon);
+        }
+    }
+    return model;
+}
+
+// 改进前 QCR::fusion 的逐行扫描, 作为对照
+int scanLocate(const TableModel &model, int col, int top, int bottom)
+{
+    for (int i = 0; i < model.rowCount(); ++i)
+    {
+        int index = TableModel::npos;
+        for (int j = col; j >= 0 && index == TableModel::npos; --j)
+            index = model.find(i, j);
+        if (index == TableModel::npos)
+            continue;
+
+        const CellRect &rc = model.rect(index);
+        if (rc.bottom > top && 2 * (rc.bottom - top) > bottom - top)
+            return index;
+        if (rc.top > bottom)
+            break;
+    }
+    return TableModel::npos;
+}
+
+int benchFusion(int argc, char *argv[])
+{
+    BenchArgs args = parseArgs(argc, argv);
+    QString out = args.option("out", "bench_fusion.json");
+    const int repeat = args.intOption("repeat", 5);
+    const int rows = args.intOption("rows", 200);
+    const int cols = args.intOption("cols", 20);
+    const int tables = args.intOption("tables", 10);
+
+    std::mt19937 rng(20240601);
+    json result = { {"benchmark", "fusion"}, {"repeat", repeat}, {"rows", rows},
+        {"cols", cols}, {"tables", json::array()} };
+    double scan_sum = 0;
+    double index_sum = 0;
+    int mismatches = 0;
+    for (int n = 0; n < tables; ++n)
+    {
+        TableModel model = syntheticTable(rows, cols, rng);
+
+        // 每个单元格中一个数字, 位置带随机偏移; 另有约十分之一落在表格下方(如页脚),
+        // 不对应任何单元格
+        std::vector<std::array<int, 3>> words;
+        std::uniform_int_distribution<int> offset(-12, 12);
+        std::uniform_int_distribution<int> below(20, 80);
+        for (int i = 0; i < rows * cols; ++i)
+        {
+            int col = i % cols;
+            int center = (i / cols) * 30 + 15 + offset(rng);
+            words.push_back({ col, center - 8, center + 8 });
+            if (i % 10 == 0)
+            {
+                center = rows * 30 + below(rng);
+                words.push_back({ col, center - 8, center + 8 });
+            }
+        }
+
+        std::vector<int> scan_res(words.size());
+        std::vector<int> index_res(words.size());
+        double t_scan = timeIt([&]() {
+            for (size_t k = 0; k < words.size(); ++k)
+                scan_res[k] = scanLocate(model, words[k][0], words[k][1], words[k][2]);
+            }, repeat);
+        double t_build = 0;
+        double t_index = timeIt([&]() {
+            auto start = std::chrono::steady_clock::now();
+            CellIndex index(model);
+            t_build += std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count() / repeat;
+            for (size_t k = 0; k < words.size(); ++k)
+                index_res[k] = index.locate(words[k][0], words[k][1], words[k][2]);
+            }, repeat);
+        int diff = 0;
+        for (size_t k = 0; k < words.size(); ++k)
+            diff += scan_res[k] != index_res[k];
+
+        scan_sum += t_scan;
+        index_sum += t_index;
+        mismatches += diff;
+        result["tables"].push_back({ {"cells", model.size()}, {"words", words.size()},
+            {"scan_ms", t_scan}, {"index_ms", t_index}, {"index_build_ms", t_build},
+            {"mismatches", diff} });
+        printLog(QString("[fusion] table %1: %2 cells, scan %3 ms, index %4 ms (build %5 ms)%6")
+            .arg(n).arg(model.size()).arg(t_scan, 0, 'f', 3).arg(t_index, 0, 'f', 3)
+            .arg(t_build, 0, 'f', 3).arg(diff ? QString(" MISMATCH %1").arg(diff) : ""));
+    }
+    int n = std::max(1, tables);
+    result["summary"] = { {"mean_scan_ms", scan_sum / n}, {"mean_index_ms", index_sum / n},
+        {"mismatches", mismatches} };
+    return saveResult(result, out) ? 0 : 1;
+}
+
+// 改进前的逐个单元格构造正则表达式的做法, 作为对照
+CellTextInfo regexClassify(const std::string &str, std::string &clean)
+{
+    QString text = QString::fromUtf8(str.c_str());
+    CellTextInfo info;
+    info.has_score_char = text.contains(QRegularExpression(u8"[平时成绩]+"));
+    info.has_score_word = text.contains(u8"平时") || text.contains(u8"成绩");
+    info.has_zh = text.contains(QRegularExpression(u8"[一-龥]+"));
+    info.has_en = text.contains(QRegularExpression(u8"[a-zA-Z]+"));
+    info.has_num = text.contains(QRegularExpression(u8"[0-9]+"));
+    info.length = text.size();
+    text.remove(QRegularExpression(u8"[^一-龥a-zA-Z0-9]+"));
+    clean = text.toStdString();
+    return info;
+}
+
+bool sameInfo(const CellTextInfo &a, const CellTextInfo &b)
+{
+    return a.has_zh == b.has_zh && a.has_en == b.has_en && a.has_num == b.has_num
+        && a.has_score_char == b.has_score_char && a.has_score_word == b.has_score_word
+        && a.length == b.length;
+}
+
+int benchCellText(int argc, char *argv[])
+{
+    BenchArgs args = parseArgs(argc, argv);
+    QString out = args.option("out", "bench_celltext.json");
+    const int repeat = args.intOption("repeat", 5);
+    const int cells = args.intOption("cells", 20000);
+
+    // 由表格中常见的片段随机拼接出单元格文本
+    const std::vector<std::string> pieces = { u8"平时成绩", u8"成绩", u8"平时", u8"张三",
+        u8"学号", u8"姓名", u8"备注", "85", "100", "7", "0", "A", "b1", " ", ".", u8"，",
+        u8"（", u8"）", "-", u8"缺考", u8"９", u8"😀" };
+    std::mt19937 rng(20240601);
+    std::uniform_int_distribution<size_t> pick(0, pieces.size() - 1);
+    std::uniform_int_distribution<int> count(1, 3);
+    std::vector<std::string> texts(cells);
+    for (auto &text : texts)
+    {
+        for (int k = count(rng); k > 0; --k)
+            text += pieces[pick(rng)];
+    }
+
+    std::vector<CellTextInfo> regex_res(texts.size());
+    std::vector<std::string> regex_clean(texts.size());
+    std::vector<CellTextInfo> table_res(texts.size());
+    std::vector<std::string> table_clean(texts.size());
+    double t_regex = timeIt([&]() {
+        for (size_t k = 0; k < texts.size(); ++k)
+            regex_res[k] = regexClassify(texts[k], regex_clean[k]);
+        }, repeat);
+    double t_table = timeIt([&]() {
+        for (size_t k = 0; k < texts.size(); ++k)
+            table_res[k] = classifyCellText(texts[k], &table_clean[k]);
+        }, repeat);
+
+    int mismatches = 0;
+    for (size_t k = 0; k < texts.size(); ++k)
+        mismatches += !sameInfo(regex_res[k], table_res[k]) || regex_clean[k] != table_clean[k];
+
+    double ns_regex = t_regex * 1e6 / cells;
+    double ns_table = t_table * 1e6 / cells;
+    json result = { {"benchmark", "celltext"}, {"repeat", repeat}, {"cells", cells},
+        {"regex_ms", t_regex}, {"table_ms", t_table},
+        {"regex_ns_per_cell", ns_regex}, {"table_ns_per_cell", ns_table},
+        {"mismatches", mismatches} };
+    printLog(QString("[celltext] %1 cells: regex %2 ns/cell, table %3 ns/cell%4")
+        .arg(cells).arg(ns_regex, 0, 'f', 1).arg(ns_table, 0, 'f', 1)
+        .arg(mismatches ? QString(" MISMATCH %1").arg(mismatches) : ""));
+    return saveResult(result, out) ? 0 : 1;
+}
+
+// 改进前的 formatPointMatrix, 逐个删除已归类的点并反复计算距离, 作为对照
+std::vector<std::vector<cv::Point>> legacyFormatPointMatrix(
+    std::vector<cv::Point> points_list,
+    const std::vector<cv::Vec3d> &lines_h,
+    const std::vector<cv::Vec3d> &lines_v)
+{
+    std::vector<std::vector<cv::Point>> matrix;
+    // matrix 的行数列数
+    int rows = lines_h.size();
+    int cols = lines_v.size();
+
+    if (points_list.size() < 4 || rows < 2 || cols < 2)
+    {
+        return matrix;
+    }
+
+    // 按横坐标 x 排序
+    std::sort(points_list.begin(), points_list.end(),
+        [](const cv::Point &p1, const cv::Point &p2) {
+            return p1.x < p2.x;
+        });
+
+    // 找出同一列的点, 一般两列之间间距大一些便于区分
+    for (auto &v : lines_v)
+    {
+        // 1. 找出距离一条竖线一定范围内的点, 认为是同一列的点
+        std::vector<cv::Point> vec;
+        double A = v[0];
+        double B = v[1];
+        double C = v[2];
+        size_t i = 0;
+        while (i != points_list.size())
+        {
+            cv::Point p = points_list[i];
+            double d = abs(A * p.x + B * p.y + C) / sqrt(A * A + B * B);
+            if (d < 20)
+            {
+                vec.push_back(p);
+                points_list.erase(points_list.begin() + i);
+                continue;
+            }
+            ++i;
+        }
+        // 按纵坐标 y 从小到大排序
+        std::sort(vec.begin(), vec.end(),
+            [](const cv::Point &p1, const cv::Point &p2) {
+                return p1.y < p2.y;
+            });
+
+        // 2. 这一列点的数量大于横线数, 即存在多余点, 需要删除
+        if (vec.size() > rows)
+        {
+            std::vector<cv::Point> copy = vec;
+            vec.clear();
+
+            // 对每条横线找距离最近的点并保留, 遍历完所有横线后剩余的点丢弃
+            for (auto &ll : lines_h)
+            {
+                double AA = ll[0];
+                double BB = ll[1];
+                double CC = ll[2];
+                // 距离横线ll最近的点的索引
+                size_t min_index = 0;
+                double dist = abs(AA * copy[0].x + BB * copy[0].y + CC)
+                    / sqrt(AA * AA + BB * BB);
+
+                size_t i = 1;
+                while (i != copy.size())
+                {
+                    double dd = abs(AA * copy[i].x + BB * copy[i].y + CC)
+                        / sqrt(AA * AA + BB * BB);
+                    if (dd < dist)
+                    {
+                        min_index = i;
+                        dist = dd;
+                    }
+                    ++i;
+                }
+                vec.push_back(copy[min_index]);
+                copy.erase(copy.begin() + min_index);
+            }
+        }
+
+        // 3. 点的数量小于行数, 即缺失部分点, 需要补全
+        else if (vec.size() < rows)
+        {
+            std::vector<cv::Point> copy = vec;
+            vec.clear();
+            vec.resize(rows, cv::Point(-1, -1));
+
+            // 把已有的点填到距离最近的横线的行数
+            for (auto &p : copy)
+            {
+                size_t min_index = 0;
+                double dist = abs(lines_h[0][0] * p.x + lines_h[0][1] * p.y + lines_h[0][2])
+                    / sqrt(lines_h[0][0] * lines_h[0][0] + lines_h[0][1] * lines_h[0][1]);
+                size_t i = 0;
+                while (i != lines_h.size())
+                {
+                    double AA = lines_h[i][0];
+                    double BB = lines_h[i][1];
+                    double CC = lines_h[i][2];
+                    double dd = abs(AA * p.x + BB * p.y + CC)
+                        / sqrt(AA * AA + BB * BB);
+                    if (dd < dist)
+                    {
+                        min_index = i;
+                        dist = dd;
+                    }
+                    ++i;
+                }
+                vec[min_index] = p;
+            }
+
+            // 缺失的点用两直线交点补齐
+            for (size_t i = 0; i < vec.size(); ++i)
+            {
+                if (vec[i] == cv::Point(-1, -1))
+                {
+                    double A2 = lines_h[i][0];
+                    double B2 = lines_h[i][1];
+                    double C2 = lines_h[i][2];
+                    int x0 = static_cast<int>((B * C2 - B2 * C) / (B2 * A - B * A2));
+                    int y0 = static_cast<int>((A * C2 - C * A2) / (B * A2 - A * B2));
+                    vec[i] = { x0, y0 };
+                }
+            }
+        }
+        matrix.push_back(vec);
+    }
+    return matrix;
+}
+
+// 生成带轻微倾斜的 rows×cols 个格子的表格线及交点, 交点带抖动, 部分缺失, 并混入多余的点
+void syntheticGrid(int rows, int cols, std::mt19937 &rng, std::vector<cv::Point> &points,
+    std::vector<cv::Vec3d> &lines_h, std::vector<cv::Vec3d> &lines_v)
+{
+    const double cell_w = 90;
+    const double cell_h = 40;
+    const double slope = 0.004;
+    std::uniform_int_distribution<int> jitter(-3, 3);
+    std::uniform_real_distribution<double> chance(0, 1);
+
+    lines_h.clear();
+    lines_v.clear();
+    points.clear();
+    // 横线 y = slope * x + y0, 竖线 x = -slope * y + x0
+    for (int i = 0; i <= rows; ++i)
+        lines_h.push_back({ slope, -1, 20 + i * cell_h });
+    for (int j = 0; j <= cols; ++j)
+        lines_v.push_back({ 1, slope, -(20 + j * cell_w) });
+
+    for (int j = 0; j <= cols; ++j)
+    {
+        for (int i = 0; i <= rows; ++i)
+        {
+            double y0 = 20 + i * cell_h;
+            double x0 = 20 + j * cell_w;
+            // 两直线交点
+            double x = (x0 - slope * y0) / (1 + slope * slope);
+            double y = slope * x + y0;
+            if (chance(rng) < 0.05)
+                continue;
+            points.push_back(cv::Point(cvRound(x) + jitter(rng), cvRound(y) + jitter(rng)));
+            // 文字笔画产生的多余点, 位于竖线附近两条横线之间
+            if (chance(rng) < 0.03 && i < rows)
+                points.push_back(cv::Point(cvRound(x) + jitter(rng), cvRound(y + cell_h / 2)));
+        }
+    }
+    std::shuffle(points.begin(), points.end(), rng);
+}
+
+int benchGrid(int argc, char *argv[])
+{
+    BenchArgs args = parseArgs(argc, argv);
+    QString out = args.option("out", "bench_grid.json");
+    const int repeat = args.intOption("repeat", 5);
+    const int rows = args.intOption("rows", 60);
+    const int cols = args.intOption("cols", 30);
+
+    std::mt19937 rng(20240601);
+    json result = { {"benchmark", "grid"}, {"repeat", repeat}, {"sizes", json::array()} };
+    // 以指定尺寸为基准, 从 1/4 到 2 倍, 观察耗时随规模的增长
+    for (double scale : { 0.25, 0.5, 1.0, 2.0 })
+    {
+        int r = std::max(2, static_cast<int>(rows * scale));
+        int c = std::max(2, static_cast<int>(cols * scale));
+        std::vector<cv::Point> points;
+        std::vector<cv::Vec3d> lines_h;
+        std::vector<cv::Vec3d> lines_v;
+        syntheticGrid(r, c, rng, points, lines_h, lines_v);
+
+        std::vector<std::vector<cv::Point>> legacy;
+        std::vector<std::vector<cv::Point>> sweep;
+        double t_legacy = timeIt([&]() { legacy = legacyFormatPointMatrix(points, lines_h, lines_v); }, repeat);
+        double t_sweep = timeIt([&]() { sweep = formatPointMatrix(points, lines_h, lines_v); }, repeat);
+        bool same = legacy == sweep;
+
+        result["sizes"].push_back({ {"rows", r}, {"cols", c}, {"points", points.size()},
+            {"legacy_ms", t_legacy}, {"sweep_ms", t_sweep}, {"identical", same} });
+        printLog(QString("[grid] %1x%2, %3 points: legacy %4 ms, sweep %5 ms%6")
+            .arg(r).arg(c).arg(points.size()).arg(t_legacy, 0, 'f', 3).arg(t_sweep, 0, 'f', 3)
+            .arg(same ? "" : " MISMATCH"));
+    }
+    return saveResult(result, out) ? 0 : 1;
+}
+
+// 完整流程的各阶段, 与 runSheet 中的顺序一致
+const char *const PIPELINE_STAGES[] = { "decode", "contour", "warp", "structure",
+    "remove_borders", "score_columns", "extract_words", "splice", "fusion" };
+constexpr int PIPELINE_STAGE_COUNT = sizeof(PIPELINE_STAGES) / sizeof(PIPELINE_STAGES[0]);
+
+// 一张测试图片及其录制的识别结果
+struct Sheet
+{
+    QString path;
+    std::string response;  // 为空时使用本地识别表格结构
+    bool baidu = false;
+};
+
+/*
+* 读取 fixtures 目录下与图片同名的识别服务返回结果, 图片 xxx.jpg 对应
+* xxx.tx.json(腾讯) 或 xxx.bd.json(百度), 内容为服务返回的原始数据
+*/
+void loadFixture(const QString &dir, Sheet &sheet)
+{
+    QString base = QFileInfo(sheet.path).completeBaseName();
+    for (bool baidu : { false, true })
+    {
+        QFile file(QDir(dir).filePath(base + (baidu ? ".bd.json" : ".tx.json")));
+        if (file.open(QIODevice::ReadOnly))
+        {
+            sheet.response = file.readAll().toStdString();
+            sheet.baidu = baidu;
+            return;
+        }
+    }
+}
+
+double peakRssMb()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return pmc.PeakWorkingSetSize / 1048576.0;
+    return 0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+// 按顺序累计各阶段耗时(ms), stages 为空时不记录
+class StageClock
+{
+public:
+    explicit StageClock(double *stages) : stages_(stages), last_(std::chrono::steady_clock::now()) {}
+
+    void lap(int stage)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (stages_)
+            stages_[stage] += std::chrono::duration<double, std::milli>(now - last_).count();
+        last_ = now;
+    }
+
+private:
+    double *stages_;
+    std::chrono::steady_clock::time_point last_;
+};
+
+/*
+* 解码、轮廓识别、校正并得到表格结构(录制的识别结果或本地识别), 即完整流程中
+* 数字识别优化之前的部分
+*/
+bool prepareSheet(const Sheet &sheet, StageClock &clock, cv::Mat &img, TableModel &model,
+    std::vector<int> &digit_columns, int &score_row)
+{
+    img = cv::imread(sheet.path.toLocal8Bit().data());
+    if (img.empty())
+        return false;
+    clock.lap(0);
+    std::vector<std::vector<double>> points_rel;
+    bool detected = detectContour(img, points_rel);
+    clock.lap(1);
+    if (detected)
+        img = warpTable(img, points_rel);
+    clock.lap(2);
+
+    std::string error;
+    score_row = 0;
+    bool ok = sheet.response.empty() ? detectTableGrid(img, model, &digit_columns, &score_row)
+        : sheet.baidu ? bdParseTable(sheet.response, model, error)
+        : txParseTable(sheet.response, model, error);
+    clock.lap(3);
+    return ok;
+}
+
+/*
+* 对一张图片执行完整流程. stages 不为空时各阶段串行执行并记录耗时(ms), 否则与界面
+* 相同使用 optimizeTable 并行处理各分数列
+*/
+bool runSheet(const Sheet &sheet, double *stages, int *changed = nullptr)
+{
+    StageClock clock(stages);
+    cv::Mat img;
+    TableModel model;
+    std::vector<int> digit_columns;
+    int score_row = 0;
+    if (!prepareSheet(sheet, clock, img, model, digit_columns, score_row))
+        return false;
+
+    if (!stages)
+    {
+        int n = static_cast<int>(optimizeTable(img, model, digit_columns, score_row).size());
+        if (changed)
+            *changed = n;
+        return true;
+    }
+
+    cv::Mat no_border = removeTableBorders(img);
+    clock.lap(4);
+    std::vector<std::vector<int>> rects;
+    getScoreColumns(model, digit_columns, rects, score_row);
+    clock.lap(5);
+    std::vector<std::vector<std::vector<int>>> words(rects.size());
+    for (size_t i = 0; i < rects.size(); ++i)
+    {
+        const std::vector<int> &rect = rects[i];
+        cv::Rect rc(rect[1], rect[3], rect[2] - rect[1], rect[4] - rect[3]);
+        extractWords(no_border(rc), rect, words[i]);
+    }
+    clock.lap(6);
+    spliceWords(words);
+    clock.lap(7);
+    int n = static_cast<int>(fuseWords(model, words).size());
+    clock.lap(8);
+    if (changed)
+        *changed = n;
+    return true;
+}
+
+int benchPipeline(int argc, char *argv[])
+{
+    BenchArgs args = parseArgs(argc, argv);
+    QString out = args.option("out", "bench_pipeline.json");
+    QString fixtures = args.option("fixtures", "test/fixtures");
+    const int repeat = args.intOption("repeat", 3);
+    const int max_threads = args.intOption("threads",
+        std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+    const int passes = args.intOption("passes", 2);
+
+    loadModel(args.option("model", "data/mnist.json").toLocal8Bit().toStdString());
+
+    std::vector<Sheet> sheets;
+    for (const QString &path : listImages(args.positional))
+    {
+        Sheet sheet;
+        sheet.path = path;
+        loadFixture(fixtures, sheet);
+        sheets.push_back(sheet);
+    }
+    if (sheets.empty())
+    {
+        printLog("[pipeline] no images");
+        return 1;
+    }
+
+    json result = { {"benchmark", "pipeline"}, {"repeat", repeat}, {"images", json::array()} };
+    std::vector<double> stage_sum(PIPELINE_STAGE_COUNT, 0);
+    double e2e_sum = 0;
+    int measured = 0;
+    for (const Sheet &sheet : sheets)
+    {
+        QString name = QFileInfo(sheet.path).fileName();
+        std::vector<double> stages(PIPELINE_STAGE_COUNT, 0);
+        int changed = 0;
+        bool ok = true;
+        for (int i = 0; i < repeat && ok; ++i)
+            ok = runSheet(sheet, stages.data(), &changed);
+        double e2e = ok ? timeIt([&]() { runSheet(sheet, nullptr); }, repeat) : 0;
+
+        json item = { {"file", name.toUtf8().data()},
+            {"structure", sheet.response.empty() ? "local" : sheet.baidu ? "bd fixture" : "tx fixture"},
+            {"ok", ok} };
+        if (ok)
+        {
+            json stage_ms = json::object();
+            for (int k = 0; k < PIPELINE_STAGE_COUNT; ++k)
+            {
+                stages[k] /= repeat;
+                stage_ms[PIPELINE_STAGES[k]] = stages[k];
+                stage_sum[k] += stages[k];
+            }
+            item["stages_ms"] = stage_ms;
+            item["end_to_end_ms"] = e2e;
+            item["cells_changed"] = changed;
+            e2e_sum += e2e;
+            ++measured;
+        }
+        result["images"].push_back(item);
+        printLog(QString("[pipeline] %1: %2, end-to-end %3 ms")
+            .arg(name).arg(ok ? "ok" : "failed").arg(e2e, 0, 'f', 1));
+    }
+
+    // 吞吐量: 多个线程同时处理图片, 每张图片内部仍按分数列并行
+    std::vector<int> thread_counts;
+    for (int threads = 1; threads < max_threads; threads *= 2)
+        thread_counts.push_back(threads);
+    thread_counts.push_back(max_threads);
+    json throughput = json::array();
+    for (int threads : thread_counts)
+    {
+        const int total = static_cast<int>(sheets.size()) * passes;
+        std::atomic<int> next{ 0 };
+        double ms = timeIt([&]() {
+            std::vector<std::thread> workers;
+            for (int t = 0; t < threads; ++t)
+            {
+                workers.emplace_back([&]() {
+                    for (int i = next++; i < total; i = next++)
+                        runSheet(sheets[i % sheets.size()], nullptr);
+                });
+            }
+            for (auto &w : workers)
+                w.join();
+        }, 1);
+        double rate = total * 1000.0 / ms;
+        throughput.push_back({ {"threads", threads}, {"sheets", total}, {"ms", ms}, {"sheets_per_s", rate} });
+        printLog(QString("[pipeline] %1 threads: %2 sheets/s").arg(threads).arg(rate, 0, 'f', 2));
+    }
+
+    json mean_stages = json::object();
+    for (int k = 0; k < PIPELINE_STAGE_COUNT; ++k)
+        mean_stages[PIPELINE_STAGES[k]] = measured ? stage_sum[k] / measured : 0;
+    result["throughput"] = throughput;
+    result["summary"] = { {"images", sheets.size()}, {"measured", measured},
+        {"mean_stages_ms", mean_stages}, {"mean_end_to_end_ms", measured ? e2e_sum / measured : 0},
+        {"peak_rss_mb", peakRssMb()} };
+    return saveResult(result, out) ? 0 : 1;
+}
+
+// 读取 csv 文件, 支持双引号包围的字段. 只比较分数, 不关心编码
+bool loadTruthCsv(const QString &path, std::vector<std::vector<std::string>> &rows)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    std::string data = file.readAll().toStdString();
+    rows.clear();
+    std::vector<std::string> row;
+    std::string field;
+    bool quoted = false;
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        char ch = data[i];
+        if (quoted)
+        {
+            if (ch == '"' && i + 1 < data.size() && data[i + 1] == '"')
+                field += data[++i];
+            else if (ch == '"')
+                quoted = false;
+            else
+                field += ch;
+        }
+        else if (ch == '"')
+        {
+            quoted = true;
+        }
+        else if (ch == ',')
+        {
+            row.push_back(std::move(field));
+            field.clear();
+        }
+        else if (ch == '\n')
+        {
+            row.push_back(std::move(field));
+            field.clear();
+            rows.push_back(std::move(row));
+            row.clear();
+        }
+        else if (ch != '\r')
+        {
+            field += ch;
+        }
+    }
+    if (!field.empty() || !row.empty())
+    {
+        row.push_back(std::move(field));
+        rows.push_back(std::move(row));
+    }
+    return true;
+}
+
+// 1到3位数字, 即可能的分数
+bool isScoreText(std::string_view text)
+{
+    return !text.empty() && text.size() <= 3 &&
+        std::all_of(text.begin(), text.end(), [](char ch) { return ch >= '0' && ch <= '9'; });
+}
+
+// 评估用的图片, 与参数无关的处理结果只计算一次
+struct EvalSheet
+{
+    QString name;
+    cv::Mat no_border;
+    TableModel model;  // 识别服务(或本地)的结果, 融合前
+    std::vector<std::vector<int>> rects;
+    std::vector<std::vector<std::string>> truth;
+
+    const std::string *truthAt(int row, int col) const
+    {
+        if (row < 0 || row >= static_cast<int>(truth.size()) || col < 0 || col >= static_cast<int>(truth[row].size()))
+            return nullptr;
+        return &truth[row][col];
+    }
+};
+
+int benchEval(int argc, char *argv[])
+{
+    BenchArgs args = parseArgs(argc, argv);
+    QString out = args.option("out", "bench_eval.json");
+    QString fixtures = args.option("fixtures", "test/fixtures");
+    QString truth_dir = args.option("truth", "test/truth");
+    loadModel(args.option("model", "data/mnist.json").toLocal8Bit().toStdString());
+
+    // 只评估有标注的图片, 图片 xxx.jpg 的标注为 truth 目录下的 xxx.csv,
+    // 行列与表格识别结果一致(可以由导出的 csv 人工校对得到)
+    std::vector<EvalSheet> sheets;
+    for (const QString &path : listImages(args.positional))
+    {
+        EvalSheet es;
+        es.name = QFileInfo(path).fileName();
+        if (!loadTruthCsv(QDir(truth_dir).filePath(QFileInfo(path).completeBaseName() + ".csv"), es.truth))
+            continue;
+        Sheet sheet;
+        sheet.path = path;
+        loadFixture(fixtures, sheet);
+        StageClock clock(nullptr);
+        cv::Mat img;
+        std::vector<int> digit_columns;
+        int score_row = 0;
+        if (!prepareSheet(sheet, clock, img, es.model, digit_columns, score_row))
+        {
+            printLog(QString("[eval] %1: failed to recognize table").arg(es.name));
+            continue;
+        }
+        es.no_border = removeTableBorders(img);
+        getScoreColumns(es.model, digit_columns, es.rects, score_row);
+        sheets.push_back(std::move(es));
+    }
+    if (sheets.empty())
+    {
+        printLog(QString("[eval] no images with ground truth in %1").arg(truth_dir));
+        return 1;
+    }
+
+    // 待扫描的参数, 各参数取值的所有组合
+    std::vector<DigitParams> grid;
+    const DigitParams def;
+    for (int min_h : args.intList("min-height", def.min_height))
+        for (int max_h : args.intList("max-height", def.max_height))
+            for (int min_w : args.intList("min-width", def.min_width))
+                for (int max_w : args.intList("max-width", def.max_width))
+                    for (int ratio : args.intList("splice-ratio", def.splice_ratio))
+                    {
+                        DigitParams p;
+                        p.min_height = min_h;
+                        p.max_height = max_h;
+                        p.min_width = min_w;
+                        p.max_width = max_w;
+                        p.splice_ratio = ratio;
+                        grid.push_back(p);
+                    }
+
+    json result = { {"benchmark", "eval"}, {"sheets", sheets.size()}, {"runs", json::array()} };
+    for (const DigitParams &params : grid)
+    {
+        int cells = 0;
+        int cloud_correct = 0;
+        int fused_correct = 0;
+        int digits = 0;
+        int length_mismatch = 0;
+        double extract_ms = 0;
+        // confusion[truth][pred]
+        std::vector<std::vector<int>> confusion(10, std::vector<int>(10, 0));
+        for (const EvalSheet &es : sheets)
+        {
+            std::vector<std::vector<std::vector<int>>> words(es.rects.size());
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < es.rects.size(); ++i)
+            {
+                const std::vector<int> &rect = es.rects[i];
+                cv::Rect rc(rect[1], rect[3], rect[2] - rect[1], rect[4] - rect[3]);
+                extractWords(es.no_border(rc), rect, words[i], params);
+                digits += static_cast<int>(words[i].size());
+            }
+            extract_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            spliceWords(words, params);
+
+            // 数字识别结果与标注逐位比较, 位数不同的只计数
+            const CellIndex cell_index(es.model);
+            for (const auto &words_col : words)
+            {
+                for (const auto &w : words_col)
+                {
+                    int index = cell_index.locate(w[0], w[3], w[4]);
+                    if (index == TableModel::npos)
+                        continue;
+                    const std::string *truth = es.truthAt(es.model.row(index), es.model.col(index));
+                    if (!truth || !isScoreText(*truth))
+                        continue;
+                    std::string pred = std::to_string(w[5]);
+                    if (pred.size() != truth->size())
+                    {
+                        ++length_mismatch;
+                        continue;
+                    }
+                    for (size_t k = 0; k < pred.size(); ++k)
+                        ++confusion[(*truth)[k] - '0'][pred[k] - '0'];
+                }
+            }
+
+            // 分数列中标注为分数的单元格, 比较融合前后的准确率
+            TableModel fused = es.model;
+            fuseWords(fused, words);
+            for (const auto &rect : es.rects)
+            {
+                for (int row = 0; row < es.model.rowCount(); ++row)
+                {
+                    int index = es.model.find(row, rect[0]);
+                    const std::string *truth = es.truthAt(row, rect[0]);
+                    if (index == TableModel::npos || !truth || !isScoreText(*truth))
+                        continue;
+                    ++cells;
+                    cloud_correct += cleanCellText(es.model.text(index)) == *truth;
+                    fused_correct += fused.text(index) == *truth;
+                }
+            }
+        }
+
+        json matrix = json::array();
+        for (const auto &row : confusion)
+            matrix.push_back(row);
+        json run = {
+            {"params", { {"min_height", params.min_height}, {"max_height", params.max_height},
+                {"min_width", params.min_width}, {"max_width", params.max_width},
+                {"splice_ratio", params.splice_ratio} }},
+            {"cells", cells},
+            {"cloud_accuracy", cells ? static_cast<double>(cloud_correct) / cells : 0},
+            {"fused_accuracy", cells ? static_cast<double>(fused_correct) / cells : 0},
+            {"digits", digits},
+            {"digits_per_s", extract_ms > 0 ? digits * 1000.0 / extract_ms : 0},
+            {"length_mismatch", length_mismatch},
+            {"confusion", matrix} };
+        result["runs"].push_back(run);
+        printLog(QString("[eval] h %1-%2, w %3-%4, splice 1/%5: cloud %6, fused %7, %8 digits/s")
+            .arg(params.min_height).arg(params.max_height).arg(params.min_width).arg(params.max_width)
+            .arg(params.splice_ratio).arg(run["cloud_accuracy"].get<double>(), 0, 'f', 4)
+            .arg(run["fused_accuracy"].get<double>(), 0, 'f', 4).arg(run["digits_per_s"].get<double>(), 0, 'f', 0));
+    }
+    return saveResult(result, out) ? 0 : 1;
+}
+
+}  // namespace
+
+int runBenchmark(int argc, char *argv[])
+{
+    static const std::map<std::string, std::function<int(int, char *[])>> benchmarks = {
+        { "morphology", benchMorphology },
+        { "contour", benchContour },
+        { "fusion", benchFusion },
+        { "celltext", benchCellText },
+        { "grid", benchGrid },
+        { "pipeline", benchPipeline },
+        { "eval", benchEval },
+    };
+
+    if (argc < 1 || benchmarks.count(argv[0]) == 0)
+    {
+        std::string names;
+        for (auto &[name, func] : benchmarks)
+            names += " " + name;
+        printLog("Usage: QCR --bench <name> [args...], available:" + names);
+        return 1;
+    }
+    return benchmarks.at(argv[0])(argc, argv);
+}
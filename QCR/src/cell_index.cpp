@@ -0,0 +1,52 @@
+﻿#include <algorithm>
+
+#include "include/cell_index.h"
+
+CellIndex::CellIndex(const TableModel &model)
+    : columns_(model.columnCount())
+{
+    const int cols = model.columnCount();
+    for (int i = 0; i < model.rowCount(); ++i)
+    {
+        // 从左往右传递该行最近的单元格
+        int cell = TableModel::npos;
+        for (int j = 0; j < cols; ++j)
+        {
+            int k = model.find(i, j);
+            if (k != TableModel::npos)
+                cell = k;
+            if (cell == TableModel::npos)
+                continue;
+
+            auto &bands = columns_[j];
+            const CellRect &rc = model.rect(cell);
+            Band band = { cell, rc.top, rc.bottom };
+            if (!bands.empty())
+            {
+                band.max_top = std::max(band.max_top, bands.back().max_top);
+                band.max_bottom = std::max(band.max_bottom, bands.back().max_bottom);
+            }
+            bands.push_back(band);
+        }
+    }
+}
+
+int CellIndex::locate(int col, int top, int bottom) const
+{
+    if (col < 0 || columns_.empty())
+        return TableModel::npos;
+    // 右侧没有单元格起始的列与最后一列相同
+    const auto &bands = columns_[std::min(col, static_cast<int>(columns_.size()) - 1)];
+
+    // 第一个下边界越过数字中线的单元格
+    auto hit = std::partition_point(bands.begin(), bands.end(), [=](const Band &band) {
+        return !(band.max_bottom > top && 2 * (band.max_bottom - top) > bottom - top);
+        });
+    // 第一个上边界低于数字底部的单元格, 扫描到这里就停止
+    auto stop = std::partition_point(bands.begin(), bands.end(), [=](const Band &band) {
+        return band.max_top <= bottom;
+        });
+    if (hit == bands.end() || hit > stop)
+        return TableModel::npos;
+    return hit->cell;
+}
@@ -0,0 +1,133 @@
+﻿#include <array>
+
+#include "include/cell_text.h"
+
+namespace
+{
+
+enum CharClass : unsigned char
+{
+    CC_OTHER = 0,
+    CC_EN = 1,
+    CC_NUM = 2,
+};
+
+// ASCII 字符类别
+constexpr std::array<unsigned char, 128> makeAsciiTable()
+{
+    std::array<unsigned char, 128> table{};
+    for (int c = '0'; c <= '9'; ++c)
+        table[c] = CC_NUM;
+    for (int c = 'a'; c <= 'z'; ++c)
+        table[c] = CC_EN;
+    for (int c = 'A'; c <= 'Z'; ++c)
+        table[c] = CC_EN;
+    return table;
+}
+
+// UTF-8 首字节对应的序列长度, 0 表示非法首字节
+constexpr std::array<unsigned char, 256> makeLeadTable()
+{
+    std::array<unsigned char, 256> table{};
+    for (int c = 0x00; c < 0x80; ++c)
+        table[c] = 1;
+    for (int c = 0xC2; c < 0xE0; ++c)
+        table[c] = 2;
+    for (int c = 0xE0; c < 0xF0; ++c)
+        table[c] = 3;
+    for (int c = 0xF0; c < 0xF5; ++c)
+        table[c] = 4;
+    return table;
+}
+
+constexpr auto ascii_table = makeAsciiTable();
+constexpr auto lead_table = makeLeadTable();
+
+constexpr char32_t CP_PING = 0x5E73;   // 平
+constexpr char32_t CP_SHI = 0x65F6;    // 时
+constexpr char32_t CP_CHENG = 0x6210;  // 成
+constexpr char32_t CP_JI = 0x7EE9;     // 绩
+
+inline bool isCont(unsigned char c)
+{
+    return (c & 0xC0) == 0x80;
+}
+
+}  // namespace
+
+CellTextInfo classifyCellText(std::string_view text, std::string *clean)
+{
+    CellTextInfo info;
+    if (clean)
+    {
+        clean->clear();
+        clean->reserve(text.size());
+    }
+
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(text.data());
+    const unsigned char *end = p + text.size();
+    char32_t prev = 0;
+    while (p < end)
+    {
+        unsigned char c = *p;
+        if (c < 0x80)
+        {
+            unsigned char cls = ascii_table[c];
+            info.has_en |= cls == CC_EN;
+            info.has_num |= cls == CC_NUM;
+            if (clean && cls != CC_OTHER)
+                clean->push_back(static_cast<char>(c));
+            ++info.length;
+            prev = c;
+            ++p;
+            continue;
+        }
+
+        // 校验多字节序列, 非法序列与 QString::fromUtf8 一样按一个替换字符计
+        int n = lead_table[c];
+        bool valid = n > 1 && end - p >= n;
+        for (int k = 1; valid && k < n; ++k)
+            valid = isCont(p[k]);
+        char32_t cp = 0;
+        if (valid)
+        {
+            cp = c & (0xFF >> (n + 1));
+            for (int k = 1; k < n; ++k)
+                cp = (cp << 6) | (p[k] & 0x3F);
+            // 过长编码、代理区及超出范围的码点
+            valid = (n == 2 || (n == 3 && cp >= 0x800 && (cp < 0xD800 || cp > 0xDFFF))
+                || (n == 4 && cp >= 0x10000 && cp <= 0x10FFFF));
+        }
+        if (!valid)
+        {
+            ++info.length;
+            prev = 0;
+            ++p;
+            continue;
+        }
+
+        info.length += cp >= 0x10000 ? 2 : 1;
+        if (cp >= 0x4E00 && cp <= 0x9FA5)
+        {
+            info.has_zh = true;
+            if (clean)
+                clean->append(reinterpret_cast<const char *>(p), n);
+            if (cp == CP_PING || cp == CP_SHI || cp == CP_CHENG || cp == CP_JI)
+            {
+                info.has_score_char = true;
+                info.has_score_word |= (prev == CP_PING && cp == CP_SHI)
+                    || (prev == CP_CHENG && cp == CP_JI);
+            }
+        }
+        prev = cp;
+        p += n;
+    }
+    return info;
+}
+
+std::string cleanCellText(std::string_view text)
+{
+    std::string clean;
+    classifyCellText(text, &clean);
+    return clean;
+}
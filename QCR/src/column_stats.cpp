@@ -0,0 +1,102 @@
+﻿#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "include/column_stats.h"
+
+namespace
+{
+
+// 对 values 部分排序求中位数, 偶数个时取中间两个的平均值
+double median(std::vector<int> &values)
+{
+    size_t n = values.size();
+    auto mid = values.begin() + n / 2;
+    std::nth_element(values.begin(), mid, values.end());
+    if (n % 2 == 1)
+        return *mid;
+    // 偶数个时下中位数为左半部分的最大值
+    int lower = *std::max_element(values.begin(), mid);
+    return (static_cast<double>(lower) + *mid) / 2;
+}
+
+}  // namespace
+
+RobustStats robustStats(std::vector<int> &values, double trim)
+{
+    RobustStats st;
+    st.count = static_cast<int>(values.size());
+    if (values.empty())
+        return st;
+
+    // 截尾均值需要两端的顺序统计量, 直接整体排序
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    st.median = n % 2 == 1 ? values[n / 2]
+        : (static_cast<double>(values[n / 2 - 1]) + values[n / 2]) / 2;
+    size_t cut = static_cast<size_t>(n * std::clamp(trim, 0.0, 0.49));
+    st.trimmed_mean = std::accumulate(values.begin() + cut, values.end() - cut, 0.0)
+        / static_cast<double>(n - 2 * cut);
+
+    // 绝对偏差, 原地改写, 偏差取整不影响像素级的判断
+    for (int &v : values)
+        v = static_cast<int>(std::lround(std::abs(v - st.median)));
+    st.mad = 1.4826 * median(values);
+    return st;
+}
+
+void ColumnStats::clear()
+{
+    for (auto &edge : edges_)
+        edge.clear();
+}
+
+void ColumnStats::add(int left, int top, int right, int bottom)
+{
+    edges_[LEFT].push_back(left);
+    edges_[TOP].push_back(top);
+    edges_[RIGHT].push_back(right);
+    edges_[BOTTOM].push_back(bottom);
+}
+
+RobustStats ColumnStats::stats(Edge edge, double trim) const
+{
+    scratch_.assign(edges_[edge].begin(), edges_[edge].end());
+    return robustStats(scratch_, trim);
+}
+
+CellRect ColumnStats::inlierRange(Edge edge, double k, double min_tol) const
+{
+    CellRect rc;
+    if (empty())
+        return rc;
+
+    scratch_.assign(edges_[edge].begin(), edges_[edge].end());
+    const double med = median(scratch_);
+    for (int &v : scratch_)
+        v = static_cast<int>(std::lround(std::abs(v - med)));
+    // scratch_ 的顺序已经打乱, 只用来求 MAD
+    const double tol = std::max(k * 1.4826 * median(scratch_), min_tol);
+
+    bool found = false;
+    const std::vector<int> &values = edges_[edge];
+    for (int i = 0; i < size(); ++i)
+    {
+        if (std::abs(values[i] - med) > tol)
+            continue;
+        if (!found)
+        {
+            rc = { edges_[LEFT][i], edges_[TOP][i], edges_[RIGHT][i], edges_[BOTTOM][i] };
+            found = true;
+            continue;
+        }
+        rc.left = std::min(rc.left, edges_[LEFT][i]);
+        rc.top = std::min(rc.top, edges_[TOP][i]);
+        rc.right = std::max(rc.right, edges_[RIGHT][i]);
+        rc.bottom = std::max(rc.bottom, edges_[BOTTOM][i]);
+    }
+    // 分成相距很远的两组时可能全部被剔除, 此时使用所有单元格
+    if (!found)
+        return inlierRange(edge, 0, HUGE_VAL);
+    return rc;
+}
@@ -68,6 +68,12 @@ void ConfigDialog::loadConfig()
 
         bl = (*tbl)[CFG_NORMAL_AUTO_OPTIMIZE].value_or(false);    
         ui.check_auto_optimize->setChecked(bl);
+
+        bl = (*tbl)[CFG_NORMAL_USE_TEMPLATE].value_or(true);
+        ui.check_use_template->setChecked(bl);
+
+        integer = (*tbl)[CFG_NORMAL_PDF_DPI].value_or(200);
+        ui.spin_pdf_dpi->setValue(integer);
     }
     if (config_table.contains(CFG_SECTION_TX))
     {
@@ -142,6 +148,10 @@ void ConfigDialog::updateConfig()
     normal_table.insert_or_assign(CFG_NORMAL_AUTO_EDGE_DETECTION, bl);
     bl = ui.check_auto_optimize->isChecked();
     normal_table.insert_or_assign(CFG_NORMAL_AUTO_OPTIMIZE, bl);
+    bl = ui.check_use_template->isChecked();
+    normal_table.insert_or_assign(CFG_NORMAL_USE_TEMPLATE, bl);
+    integer = ui.spin_pdf_dpi->value();
+    normal_table.insert_or_assign(CFG_NORMAL_PDF_DPI, integer);
     config_table.insert_or_assign(CFG_SECTION_NORMAL, normal_table);
 
     toml::table bd_table;
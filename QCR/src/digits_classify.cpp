@@ -7,13 +7,10 @@
 
 #include "../include/digits_classify.h"
 #include "../include/helper.h"
+#include "../include/metrics.h"
 
 std::unique_ptr<fdeep::model> model;
 
-// Image size in MNIST database
-const int width = 28;
-const int height = 28;
-
 void loadModel(const std::string &file_name)
 {
     printLog(QString::fromUtf8(u8"加载数字识别模型: %1").arg(file_name.c_str()));
@@ -27,41 +24,161 @@ void loadModel(const std::string &file_name)
     }
 }
 
-void stdProcImg(cv::Mat &img)
+namespace
+{
+
+/*
+* 标准化映射核. 以与 cv::resize(INTER_LINEAR) 相同的半像素对齐方式, 对标准图中
+* 每个像素反算其在源图中的位置并双线性插值, 源图范围外视为背景0.
+* at(x, y) 返回源图在整数坐标处的值, 范围[0, 1].
+*/
+template <typename Pixel>
+void mapToSlot(int cols, int rows, const Shear &shear, Pixel &&at, float *dst)
 {
-    if (img.channels() == 3)
-        cv::cvtColor(img, img, cv::COLOR_BGR2GRAY);
+    std::fill(dst, dst + DIGIT_PIXELS, 0.0f);
+    if (cols <= 0 || rows <= 0)
+        return;
+
+    // 剪切后左右各需要留出的宽度
+    int pad = shear.skew == 0.0 ? 0 : cvCeil(std::abs(shear.skew) * rows / 2);
+    int w = cols + 2 * pad;
+
     // 压缩到24×24, 然后添加两三个像素的边框
-    double scale = std::min(static_cast<double>(width - 4) / img.cols,
-        static_cast<double>(height - 4) / img.rows);
-    cv::resize(img, img, cv::Size(), scale, scale);
-    int top = (height - img.rows) / 2;
-    int bottom = height - img.rows - top;
-    int left = (width - img.cols) / 2;
-    int right = width - img.cols - left;
-    cv::copyMakeBorder(img, img, top, bottom, left, right, cv::BORDER_CONSTANT, cv::Scalar(0));
+    double scale = std::min(static_cast<double>(DIGIT_SIDE - 4) / w,
+        static_cast<double>(DIGIT_SIDE - 4) / rows);
+    int sw = std::max(1, cvRound(w * scale));
+    int sh = std::max(1, cvRound(rows * scale));
+    int top = (DIGIT_SIDE - sh) / 2;
+    int left = (DIGIT_SIDE - sw) / 2;
+
+    auto px = [&](int x, int y) {
+        return (x < 0 || y < 0 || x >= cols || y >= rows) ? 0.0f : at(x, y);
+    };
+    for (int dy = 0; dy < sh; ++dy)
+    {
+        double fy = (dy + 0.5) / scale - 0.5;
+        int y0 = cvFloor(fy);
+        float ay = static_cast<float>(fy - y0);
+        // 水平剪切只改变横坐标, 每行的偏移量相同
+        double offset = shear.skew * (fy - shear.cy) - pad;
+        float *row = dst + (top + dy) * DIGIT_SIDE + left;
+        for (int dx = 0; dx < sw; ++dx)
+        {
+            double fx = (dx + 0.5) / scale - 0.5 + offset;
+            int x0 = cvFloor(fx);
+            float ax = static_cast<float>(fx - x0);
+            row[dx] = (1 - ay) * ((1 - ax) * px(x0, y0) + ax * px(x0 + 1, y0))
+                + ay * ((1 - ax) * px(x0, y0 + 1) + ax * px(x0 + 1, y0 + 1));
+        }
+    }
+}
+
+int argmax(const fdeep::tensors &result)
+{
+    const std::vector<float> vec = result.front().to_vector();
+    auto it = std::max_element(vec.begin(), vec.end());
+    return static_cast<int>(std::distance(vec.begin(), it));
+}
+
+}  // namespace
+
+Shear getShear(const cv::Mat &labels, int label)
+{
+    // 直接在标记图上累加各阶矩, 不生成字符的掩码图片
+    double m00 = 0, m01 = 0, m11 = 0, m02 = 0, m10 = 0;
+    for (int y = 0; y < labels.rows; ++y)
+    {
+        const int *row = labels.ptr<int>(y);
+        for (int x = 0; x < labels.cols; ++x)
+        {
+            if (row[x] != label)
+                continue;
+            m00 += 1;
+            m10 += x;
+            m01 += y;
+            m11 += static_cast<double>(x) * y;
+            m02 += static_cast<double>(y) * y;
+        }
+    }
+
+    Shear shear;
+    if (m00 == 0)
+        return shear;
+    double cy = m01 / m00;
+    double mu11 = m11 - m10 * cy;
+    double mu02 = m02 - m01 * cy;
+    if (std::abs(mu02) < 1e-2)
+        return shear;
+    double skew = mu11 / mu02;
+    if (std::abs(skew) >= std::tan(DESKEW_ANGLE * CV_PI / 180))
+    {
+        shear.skew = skew;
+        shear.cy = cy;
+    }
+    return shear;
+}
+
+void stdProcLabel(const cv::Mat &labels, int label, const Shear &shear, float *dst)
+{
+    CV_Assert(labels.type() == CV_32SC1);
+    mapToSlot(labels.cols, labels.rows, shear,
+        [&](int x, int y) { return labels.at<int>(y, x) == label ? 1.0f : 0.0f; }, dst);
+}
+
+void stdProcImg(const cv::Mat &img, float *dst)
+{
+    CV_Assert(img.depth() == CV_8U && (img.channels() == 1 || img.channels() == 3));
+    if (img.channels() == 1)
+    {
+        mapToSlot(img.cols, img.rows, Shear(),
+            [&](int x, int y) { return img.at<uchar>(y, x) / 255.0f; }, dst);
+    }
+    else
+    {
+        // 与 cv::COLOR_BGR2GRAY 相同的权重
+        mapToSlot(img.cols, img.rows, Shear(),
+            [&](int x, int y) {
+                const cv::Vec3b &p = img.at<cv::Vec3b>(y, x);
+                return (0.114f * p[0] + 0.587f * p[1] + 0.299f * p[2]) / 255.0f;
+            }, dst);
+    }
 }
 
 int predict(const cv::Mat &src)
 {
-    cv::Mat img = src.clone();
-    stdProcImg(img);
-    if (!img.isContinuous())
-        img = img.clone();
+    float slot[DIGIT_PIXELS];
+    stdProcImg(src, slot);
 
-    const auto input = fdeep::tensor_from_bytes(img.ptr(), 28, 28, 1, 0.0f, 1.0f);
+    const auto input = fdeep::tensor(fdeep::tensor_shape(DIGIT_SIDE, DIGIT_SIDE, 1),
+        fdeep::float_vec(slot, slot + DIGIT_PIXELS));
     const auto result = model->predict({ input });
     //std::cout << fdeep::show_tensors(result) << std::endl;
 
-    const std::vector<float> vec = result.front().to_vector();
-    auto it = std::max_element(vec.begin(), vec.end());
-    int predict = std::distance(vec.begin(), it);
+    return argmax(result);
+}
+
+std::vector<int> predictBatch(const float *batch, size_t count)
+{
+    // 识别速度由 qcr_digits_classified_total 的增长率得到
+    static Counter &classified = metrics().counter("qcr_digits_classified_total", "Digits classified by the local model");
+    STAGE_TIMER("predict");
+    classified.inc(count);
+    // fdeep 的张量自行持有数据, 每个字符仍需一次拷贝
+    std::vector<fdeep::tensors> inputs;
+    inputs.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float *slot = batch + i * DIGIT_PIXELS;
+        inputs.push_back({ fdeep::tensor(fdeep::tensor_shape(DIGIT_SIDE, DIGIT_SIDE, 1),
+            fdeep::float_vec(slot, slot + DIGIT_PIXELS)) });
+    }
 
-    // 保存图片并以识别结果命名用于查看识别效果
-    //static int index = 1;
-    //std::string file = "classify/" + std::to_string(predict) + "_" + std::to_string(index) + ".jpg";
-    //cv::imwrite(file, img);
-    //++index;
+    // 调用方已按列并行, 此处不再开启多线程
+    const auto results = model->predict_multi(inputs, false);
 
-    return predict;
+    std::vector<int> numbers;
+    numbers.reserve(count);
+    for (const auto &result : results)
+        numbers.push_back(argmax(result));
+    return numbers;
 }
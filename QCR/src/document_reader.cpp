@@ -0,0 +1,108 @@
+﻿#include <QFileInfo>
+#include <QImage>
+#include <QImageReader>
+#include <QPainter>
+#include <QPdfDocument>
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+
+#include "include/document_reader.h"
+#include "include/helper.h"
+#include "include/trace.h"
+#include "include/metrics.h"
+
+namespace
+{
+bool isPdf(const QString &path)
+{
+    return QFileInfo(path).suffix().compare("pdf", Qt::CaseInsensitive) == 0;
+}
+
+// RGB888 图片转换为 BGR, 复制数据后与 QImage 无关
+cv::Mat toBgr(const QImage &rgb)
+{
+    cv::Mat view(rgb.height(), rgb.width(), CV_8UC3,
+        const_cast<uchar *>(rgb.constBits()), static_cast<size_t>(rgb.bytesPerLine()));
+    cv::Mat bgr;
+    cv::cvtColor(view, bgr, cv::COLOR_RGB2BGR);
+    return bgr;
+}
+
+cv::Mat readPdfPage(const QString &path, int page, int dpi, int len)
+{
+    QPdfDocument doc;
+    if (doc.load(path) != QPdfDocument::NoError || page < 0 || page >= doc.pageCount())
+        return cv::Mat();
+
+    // 页面尺寸以点(1/72英寸)为单位
+    QSizeF size = doc.pageSize(page) * (dpi / 72.0);
+    double side = std::max(size.width(), size.height());
+    if (side > len)
+        size *= len / side;
+    QImage rendered = doc.render(page, size.toSize());
+    if (rendered.isNull())
+        return cv::Mat();
+
+    // 透明背景按白纸处理
+    QImage rgb(rendered.size(), QImage::Format_RGB888);
+    rgb.fill(Qt::white);
+    QPainter painter(&rgb);
+    painter.drawImage(0, 0, rendered);
+    painter.end();
+    return toBgr(rgb);
+}
+
+cv::Mat readTiffPage(const QString &path, int page, int len)
+{
+    QImageReader reader(path);
+    if (!reader.jumpToImage(page))
+        return cv::Mat();
+    QImage image = reader.read();
+    if (image.isNull())
+        return cv::Mat();
+
+    cv::Mat img = toBgr(image.convertToFormat(QImage::Format_RGB888));
+    if (img.rows > len || img.cols > len)
+    {
+        double scale = static_cast<double>(len) / std::max(img.rows, img.cols);
+        cv::resize(img, img, cv::Size(), scale, scale, cv::INTER_AREA);
+    }
+    return img;
+}
+}
+
+bool isDocument(const QString &path)
+{
+    QString suffix = QFileInfo(path).suffix().toLower();
+    return suffix == "pdf" || suffix == "tif" || suffix == "tiff";
+}
+
+int documentPageCount(const QString &path)
+{
+    if (isPdf(path))
+    {
+        QPdfDocument doc;
+        if (doc.load(path) != QPdfDocument::NoError)
+            return 0;
+        return doc.pageCount();
+    }
+    QImageReader reader(path);
+    if (!reader.canRead())
+        return 0;
+    // 不支持多图的格式返回0, 按一页处理
+    return std::max(reader.imageCount(), 1);
+}
+
+cv::Mat readDocumentPage(const QString &path, int page, int dpi, int len)
+{
+    TRACE_SCOPE("readDocumentPage", page);
+    STAGE_TIMER("read_document_page");
+    cv::Mat img = isPdf(path) ? readPdfPage(path, page, dpi, len) : readTiffPage(path, page, len);
+    if (img.empty())
+        printLog(QString::fromUtf8(u8"无法读取第%1页: %2").arg(page + 1).arg(path));
+    else
+        printLog(QString::fromUtf8(u8"已读取第%1页: %2x%3").arg(page + 1).arg(img.cols).arg(img.rows));
+    return img;
+}
@@ -0,0 +1,323 @@
+﻿#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <chrono>
+
+#include "include/edge_detection.h"
+#include "include/helper.h"
+
+double getDistance(const cv::Vec4i &line, const cv::Point &point)
+{
+    double A = line[3] - line[1];
+    double B = line[0] - line[2];
+    double C = line[2] * line[1] - line[0] * line[3];
+    return std::abs(A * point.x + B * point.y + C) / std::sqrt(A * A + B * B);
+}
+
+cv::Point getIntersection(const cv::Vec4i &l1, const cv::Vec4i &l2)
+{
+    double A1 = l1[3] - l1[1];
+    double B1 = l1[0] - l1[2];
+    double C1 = l1[2] * l1[1] - l1[0] * l1[3];
+    double A2 = l2[3] - l2[1];
+    double B2 = l2[0] - l2[2];
+    double C2 = l2[2] * l2[1] - l2[0] * l2[3];
+
+    int x = (B1 * C2 - B2 * C1) / (B2 * A1 - B1 * A2);
+    int y = (A1 * C2 - C1 * A2) / (B1 * A2 - A1 * B2);
+    return cv::Point(x, y);
+}
+
+void getVertexes(std::vector<cv::Vec4i> &lines, std::vector<cv::Point> &points)
+{
+    // ---------- 按斜率分类横向线段和竖向线段 ---------- //
+    std::vector<cv::Vec4i> h_lines;
+    std::vector<cv::Vec4i> v_lines;
+    for (auto line : lines)
+    {
+        double k = std::abs(static_cast<double>(line[3] - line[1]) / (line[2] - line[0]));
+        if (k < 1.0)
+        {
+            // 确保 x1 < x2
+            if (line[0] > line[2])
+            {
+                int tmp = line[0];
+                line[0] = line[2];
+                line[2] = tmp;
+                tmp = line[1];
+                line[1] = line[3];
+                line[3] = tmp;
+            }
+            h_lines.push_back(line);
+        }
+        else
+        {
+            // 确保 y1 < y2
+            if (line[1] > line[3])
+            {
+                int tmp = line[0];
+                line[0] = line[2];
+                line[2] = tmp;
+                tmp = line[1];
+                line[1] = line[3];
+                line[3] = tmp;
+            }
+            v_lines.push_back(line);
+        }
+    }
+    if (h_lines.size() < 2 || v_lines.size() < 2)
+    {
+        printLog(QString::fromUtf8(u8"检测到的横线(%1)或竖线(%2)数量不足, 无法构成有效边")
+            .arg(h_lines.size()).arg(v_lines.size()));
+        return;
+    }
+
+    // ---------- 合并横向线段 ---------- //
+    // 按端点y坐标从小到大排序
+    std::sort(h_lines.begin(), h_lines.end(),
+        [&](const cv::Vec4i &l1, const cv::Vec4i &l2) {
+            return l1[1] < l2[1];
+        });
+    cv::Vec4i hu_line = h_lines.front();
+    cv::Vec4i hb_line = h_lines.back();
+
+    double d1;
+    double d2;
+    // 判断是否同一条直线的距离阈值
+    double threshold = 10.0;
+    printLog(QString::fromUtf8(u8"距离阈值: %1").arg(threshold));
+    
+    for (size_t i = 1; i < h_lines.size() -1; ++i)
+    {
+        cv::Vec4i line = h_lines[i];
+        d1 = getDistance(line, cv::Point(hu_line[0], hu_line[1]));
+        d2 = getDistance(line, cv::Point(hb_line[0], hb_line[1]));
+        if (d1 < threshold)
+        {
+            if (line[0] < hu_line[0])
+            {
+                hu_line[0] = line[0];
+                hu_line[1] = line[1];
+            }
+            if (line[2] > hu_line[2])
+            {
+                hu_line[2] = line[2];
+                hu_line[3] = line[3];
+            }
+        }
+        else if (d2 < threshold)
+        {
+            if (line[0] < hb_line[0])
+            {
+                hb_line[0] = line[0];
+                hb_line[1] = line[1];
+            }
+            if (line[2] > hb_line[2])
+            {
+                hb_line[2] = line[2];
+                hb_line[3] = line[3];
+            }
+        }
+    }
+
+    // ---------- 合并竖向线段 ---------- //
+    // 按端点x坐标从小到大排序
+    std::sort(v_lines.begin(), v_lines.end(),
+        [&](const cv::Vec4i &l1, const cv::Vec4i &l2) {
+            return l1[0] < l2[0];
+        });
+    cv::Vec4i vl_line = v_lines.front();
+    cv::Vec4i vr_line = v_lines.back();
+
+    for (size_t i = 1; i < v_lines.size() - 1; ++i)
+    {
+        cv::Vec4i line = v_lines[i];
+        d1 = getDistance(line, cv::Point(vl_line[0], vl_line[1]));
+        d2 = getDistance(line, cv::Point(vr_line[0], vr_line[1]));
+        if (d1 < threshold)
+        {
+            if (line[1] < vl_line[1])
+            {
+                vl_line[0] = line[0];
+                vl_line[1] = line[1];
+            }
+            if (line[3] > vl_line[3])
+            {
+                vl_line[2] = line[2];
+                vl_line[3] = line[3];
+            }
+        }
+        else if (d2 < threshold)
+        {
+            if (line[1] < vr_line[1])
+            {
+                vr_line[0] = line[0];
+                vr_line[1] = line[1];
+            }
+            if (line[3] > vr_line[3])
+            {
+                vr_line[2] = line[2];
+                vr_line[3] = line[3];
+            }
+        }
+    }
+
+    lines = { vl_line, hu_line, vr_line, hb_line };
+
+    // ---------- 计算直线的交点 ---------- //
+    // 多次转换导致还原后的值相对实际值要小一点
+    // 所以通过减的少一些, 加的多一些来补偿
+    cv::Point ul = getIntersection(vl_line, hu_line); // up_left
+    ul.x -= 2;
+    ul.y -= 2;
+    cv::Point ur = getIntersection(vr_line, hu_line); // up_right 
+    ur.x += 4;
+    ur.y -= 2;
+    cv::Point br = getIntersection(vr_line, hb_line); // bottom_right
+    br.x += 4;
+    br.y += 4;
+    cv::Point bl = getIntersection(vl_line, hb_line); // bottom_left
+    bl.x -= 2;
+    bl.y += 4;
+
+    points = { ul, ur, br, bl };
+}
+
+bool detectContour(const cv::Mat &src, std::vector<std::vector<double>> &points_rel,
+    int len, ContourTimings *timings)
+{
+    printLog(QString::fromUtf8(u8"开始轮廓识别"));
+    ContourTimings t;
+    auto start = std::chrono::steady_clock::now();
+    auto last = start;
+    // 返回距上次调用经过的时间(ms)
+    auto lap = [&last]() {
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::duration<double, std::milli> d = now - last;
+        last = now;
+        return d.count();
+    };
+    // 记录总耗时并输出各阶段耗时
+    auto finish = [&](bool ok) {
+        std::chrono::duration<double, std::milli> d = std::chrono::steady_clock::now() - start;
+        t.total = d.count();
+        if (timings)
+            *timings = t;
+        return ok;
+    };
+
+    cv::Mat img = src;
+
+    // 缩小图片到宽高不超过 len 像素以加快处理速度
+    if (img.rows > len || img.cols > len)
+    {
+        double r = static_cast<double>(img.rows);
+        double c = static_cast<double>(img.cols);
+        double scale = len / r < len / c ? len / r : len / c;
+        cv::resize(img, img, cv::Size(), scale, scale, cv::INTER_AREA);
+        printLog(QString::fromUtf8(u8"缩小图片至%1x%2以加快识别速度").arg(img.cols).arg(img.rows));
+    }
+
+    // 检查是否为灰度图，如果不是，转化为灰度图
+    cv::Mat gray = img;
+    if (img.channels() == 3)
+        cvtColor(img, gray, CV_BGR2GRAY);
+    t.resize = lap();
+
+    // 双边滤波
+    cv::Mat blured;
+    cv::bilateralFilter(gray, blured, 5, 70, 70);
+    t.bilateral = lap();
+
+    // 自动计算阈值
+    cv::Mat _tmp;
+    double otsu_thresh_val = 0.8 * cv::threshold(
+        blured, _tmp, 0, 255, CV_THRESH_BINARY | CV_THRESH_OTSU);
+    printLog("Otsu thresh value: " + std::to_string(otsu_thresh_val));
+
+    // 边缘检测
+    cv::Mat canny;
+    Canny(blured, canny, 0.5 * otsu_thresh_val, otsu_thresh_val, 3, true);
+    // 如果表格外围没有更多文字或其他干扰因素, 加上以下两行应该可以获得更好的轮廓
+    //cv::dilate(canny, canny, cv::Mat());
+    //Canny(canny, canny, 50, 150);
+    t.canny = lap();
+
+    std::vector<std::vector<cv::Point>> contours;
+    // 只检测外围轮廓, 内轮廓被忽略
+    findContours(canny, contours, cv::RETR_LIST, cv::CHAIN_APPROX_SIMPLE);
+    if (contours.empty())
+    {
+        printLog(QString::fromUtf8(u8"未检测到轮廓, 轮廓识别失败"));
+        return finish(false);
+    }
+
+    // 先找出面积最大的轮廓, 只对它计算凸包并折线化
+    double area = 0;
+    size_t index = 0;
+    for (size_t i = 0; i < contours.size(); ++i)
+    {
+        double a = cv::contourArea(contours[i]);
+        if (a > area)
+        {
+            area = a;
+            index = i;
+        }
+    }
+    std::vector<std::vector<cv::Point>> hull(1);
+    cv::convexHull(contours[index], hull[0]); // 凸包点, 顺时针方向
+    approxPolyDP(hull[0], hull[0], 0.05 * cv::arcLength(hull[0], true), true); // 折线化
+    t.contours = lap();
+
+    int count = hull[0].size();
+    printLog(QString::fromUtf8(u8"轮廓上点的数量: %1").arg(count));
+    // 四个顶点: 左上、右上、右下、左下
+    std::vector<cv::Point> points;
+    if (count < 4)
+    {
+        printLog(QString::fromUtf8(u8"外轮廓点的数量不足4, 无法构成四边形, 轮廓识别失败"));
+        return finish(false);
+    }
+    else if (count == 4)
+    {
+        points = hull[0];
+        // 最多旋转3次, 避免特殊形状的四边形导致死循环
+        for (int n = 0; n < 4; ++n)
+        {
+            if (points[0].x < points[1].x && points[0].x < points[2].x
+                && points[0].y < points[2].y && points[0].y < points[3].y)
+                break;
+            std::rotate(points.begin(), points.begin() + 1, points.end());
+        }
+    }
+    else
+    {
+        // 创建纯黑灰度图
+        cv::Mat black = cv::Mat::zeros(gray.size(), CV_8UC1);
+        cv::drawContours(black, hull, -1, cv::Scalar(255), 1);
+
+        std::vector<cv::Vec4i> lines;
+        cv::HoughLinesP(black, lines, 1, CV_PI / 180, 50, 100, 50);
+        printLog(QString::fromUtf8(u8"检测到%1条线段").arg(lines.size()));
+        t.hough = lap();
+
+        getVertexes(lines, points);
+        t.vertex = lap();
+        if (points.size() != 4)
+        {
+            printLog(QString::fromUtf8(u8"无法获取到有效顶点, 轮廓识别失败"));
+            return finish(false);
+        }
+    }
+
+    // 转相对坐标
+    points_rel.clear();
+    for (const auto &p : points)
+    {
+        double _x = static_cast<double>(p.x) / img.cols;
+        double _y = static_cast<double>(p.y) / img.rows;
+        points_rel.push_back({ _x, _y });
+    }
+    printLog(QString::fromUtf8(u8"轮廓识别结束"));
+    return finish(true);
+}
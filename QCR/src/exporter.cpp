@@ -0,0 +1,583 @@
+﻿#include <QDir>
+#include <QFile>
+#include <QRegularExpression>
+#include <QTextCodec>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+#include "include/exporter.h"
+
+namespace
+{
+
+constexpr size_t BUFFER_SIZE = 1 << 20;
+
+// 带缓冲的文件输出, 缓冲区满或关闭时才写入文件. 写入的都是 UTF-8 文本,
+// 指定 GB18030 时在写入文件前整块转换编码
+class FileSink
+{
+public:
+    explicit FileSink(const QString &path, ExportEncoding encoding = ExportEncoding::Utf8)
+        : file_(path),
+        codec_(encoding == ExportEncoding::Gb18030 ? QTextCodec::codecForName("GB18030") : nullptr)
+    {
+        ok_ = file_.open(QIODevice::WriteOnly);
+        buf_.reserve(BUFFER_SIZE);
+    }
+
+    ~FileSink() { close(); }
+
+    bool ok() const { return ok_; }
+    QString errorString() const { return file_.errorString(); }
+
+    // 已写入的字节数, 只在不转换编码时有意义
+    uint64_t pos() const { return written_ + buf_.size(); }
+
+    void write(std::string_view s)
+    {
+        buf_.append(s);
+        if (buf_.size() >= BUFFER_SIZE)
+            flush();
+    }
+
+    void put(char c)
+    {
+        buf_.push_back(c);
+        if (buf_.size() >= BUFFER_SIZE)
+            flush();
+    }
+
+    bool close()
+    {
+        flush(true);
+        if (file_.isOpen())
+            file_.close();
+        return ok_;
+    }
+
+private:
+    // 缓冲区末尾不完整的 UTF-8 字符的起始位置, 末尾字符完整时返回 size
+    static size_t completeLength(const std::string &s)
+    {
+        size_t n = s.size();
+        // 从末尾向前找到最后一个字符的首字节, 最多回退3个后续字节
+        size_t lead = n;
+        while (lead > 0 && n - lead < 4 && (static_cast<unsigned char>(s[lead - 1]) & 0xC0) == 0x80)
+            --lead;
+        if (lead == 0)
+            return n;
+        unsigned char c = static_cast<unsigned char>(s[lead - 1]);
+        size_t len = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+        return n - (lead - 1) < len ? lead - 1 : n;
+    }
+
+    // put 逐字节写入, 转换编码时保留末尾不完整的字符, 留到下一次连同后续字节一起转换
+    void flush(bool final = false)
+    {
+        size_t len = codec_ && !final ? completeLength(buf_) : buf_.size();
+        if (ok_ && len > 0)
+        {
+            if (codec_)
+            {
+                QByteArray bytes = codec_->fromUnicode(
+                    QString::fromUtf8(buf_.data(), static_cast<int>(len)));
+                ok_ = file_.write(bytes) == bytes.size();
+            }
+            else
+            {
+                ok_ = file_.write(buf_.data(), len) == static_cast<qint64>(len);
+            }
+        }
+        written_ += len;
+        buf_.erase(0, len);
+    }
+
+    QFile file_;
+    QTextCodec *codec_;
+    std::string buf_;
+    uint64_t written_ = 0;
+    bool ok_ = false;
+};
+
+std::string_view cellText(const TableModel &table, int row, int col)
+{
+    int k = table.find(row, col);
+    return k == TableModel::npos ? std::string_view() : table.text(k);
+}
+
+/******************************** CSV ********************************/
+
+// 含有分隔符、引号或换行时加引号, 引号转义为两个引号
+void writeCsvField(FileSink &out, std::string_view text)
+{
+    if (text.find_first_of(",\"\r\n") == std::string_view::npos)
+    {
+        out.write(text);
+        return;
+    }
+    out.put('"');
+    for (char c : text)
+    {
+        if (c == '"')
+            out.put('"');
+        out.put(c);
+    }
+    out.put('"');
+}
+
+// sheet 不为空时作为首列
+void writeCsv(FileSink &out, const TableModel &table, const std::string *sheet)
+{
+    for (int i = 0; i < table.rowCount(); ++i)
+    {
+        if (sheet)
+        {
+            writeCsvField(out, *sheet);
+            out.put(',');
+        }
+        for (int j = 0; j < table.columnCount(); ++j)
+        {
+            if (j > 0)
+                out.put(',');
+            writeCsvField(out, cellText(table, i, j));
+        }
+        out.write("\r\n");
+    }
+}
+
+/******************************** XLSX ********************************/
+
+constexpr std::array<uint32_t, 256> makeCrcTable()
+{
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k)
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        table[i] = c;
+    }
+    return table;
+}
+
+constexpr auto crc_table = makeCrcTable();
+
+uint32_t crc32(std::string_view data)
+{
+    uint32_t c = 0xFFFFFFFFu;
+    for (unsigned char b : data)
+        c = crc_table[(c ^ b) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+/*
+* 只存储不压缩的 zip 写入器, xlsx 只需要最基本的 zip 格式.
+* 表格内容以文本为主, 体积不大, 省去压缩可以让导出只受 I/O 限制
+*/
+class ZipWriter
+{
+public:
+    explicit ZipWriter(FileSink &out) : out_(out) {}
+
+    void add(const std::string &name, std::string_view data)
+    {
+        Entry e = { name, crc32(data), static_cast<uint32_t>(data.size()),
+            static_cast<uint32_t>(out_.pos()) };
+        u32(0x04034b50);
+        header(e);
+        u16(0);  // extra field length
+        out_.write(name);
+        out_.write(data);
+        entries_.push_back(std::move(e));
+    }
+
+    void finish()
+    {
+        uint32_t cd_offset = static_cast<uint32_t>(out_.pos());
+        for (const Entry &e : entries_)
+        {
+            u32(0x02014b50);
+            u16(20);  // version made by
+            header(e);
+            u16(0);   // extra field length
+            u16(0);   // comment length
+            u16(0);   // disk number
+            u16(0);   // internal attributes
+            u32(0);   // external attributes
+            u32(e.offset);
+            out_.write(e.name);
+        }
+        uint32_t cd_size = static_cast<uint32_t>(out_.pos()) - cd_offset;
+        u32(0x06054b50);
+        u16(0);
+        u16(0);
+        u16(static_cast<uint16_t>(entries_.size()));
+        u16(static_cast<uint16_t>(entries_.size()));
+        u32(cd_size);
+        u32(cd_offset);
+        u16(0);
+    }
+
+private:
+    struct Entry
+    {
+        std::string name;
+        uint32_t crc;
+        uint32_t size;
+        uint32_t offset;
+    };
+
+    // 本地文件头与中央目录共有的部分, 到文件名长度为止
+    void header(const Entry &e)
+    {
+        u16(20);      // version needed
+        u16(0x0800);  // 文件名为 UTF-8
+        u16(0);       // stored
+        u16(0);       // time
+        u16(0x21);    // date, 1980-01-01
+        u32(e.crc);
+        u32(e.size);
+        u32(e.size);
+        u16(static_cast<uint16_t>(e.name.size()));
+    }
+
+    void u16(uint16_t v)
+    {
+        out_.put(static_cast<char>(v & 0xFF));
+        out_.put(static_cast<char>(v >> 8));
+    }
+
+    void u32(uint32_t v)
+    {
+        u16(static_cast<uint16_t>(v & 0xFFFF));
+        u16(static_cast<uint16_t>(v >> 16));
+    }
+
+    FileSink &out_;
+    std::vector<Entry> entries_;
+};
+
+void appendXml(std::string &xml, std::string_view text)
+{
+    for (char c : text)
+    {
+        switch (c)
+        {
+        case '&': xml += "&amp;"; break;
+        case '<': xml += "&lt;"; break;
+        case '>': xml += "&gt;"; break;
+        case '"': xml += "&quot;"; break;
+        default:
+            // XML 不允许除制表符和换行以外的控制字符
+            if (static_cast<unsigned char>(c) >= 0x20 || c == '\t' || c == '\n' || c == '\r')
+                xml += c;
+        }
+    }
+}
+
+// 列号从0开始, 转换为 A, B, ..., Z, AA, ...
+void appendCellRef(std::string &xml, int row, int col)
+{
+    char letters[8];
+    int n = 0;
+    for (++col; col > 0; col = (col - 1) / 26)
+        letters[n++] = static_cast<char>('A' + (col - 1) % 26);
+    while (n > 0)
+        xml += letters[--n];
+    xml += std::to_string(row + 1);
+}
+
+// 不超过9位且没有前导零的数字写为数值, 其余写为文本, 避免学号等丢失前导零
+bool isPlainNumber(std::string_view text)
+{
+    if (text.empty() || text.size() > 9 || (text[0] == '0' && text.size() > 1))
+        return false;
+    for (char c : text)
+    {
+        if (c < '0' || c > '9')
+            return false;
+    }
+    return true;
+}
+
+std::string sheetXml(const TableModel &table)
+{
+    std::string xml = "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<worksheet xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\"><sheetData>";
+    for (int i = 0; i < table.rowCount(); ++i)
+    {
+        bool row_open = false;
+        for (int j = 0; j < table.columnCount(); ++j)
+        {
+            std::string_view text = cellText(table, i, j);
+            if (text.empty())
+                continue;
+            if (!row_open)
+            {
+                xml += "<row r=\"" + std::to_string(i + 1) + "\">";
+                row_open = true;
+            }
+            xml += "<c r=\"";
+            appendCellRef(xml, i, j);
+            if (isPlainNumber(text))
+            {
+                xml += "\"><v>";
+                xml += text;
+                xml += "</v></c>";
+            }
+            else
+            {
+                xml += "\" t=\"inlineStr\"><is><t xml:space=\"preserve\">";
+                appendXml(xml, text);
+                xml += "</t></is></c>";
+            }
+        }
+        if (row_open)
+            xml += "</row>";
+    }
+    xml += "</sheetData>";
+
+    std::string merges;
+    int merge_count = 0;
+    for (int k = 0; k < table.size(); ++k)
+    {
+        if (table.rowSpan(k) == 1 && table.colSpan(k) == 1)
+            continue;
+        merges += "<mergeCell ref=\"";
+        appendCellRef(merges, table.row(k), table.col(k));
+        merges += ':';
+        appendCellRef(merges, table.row(k) + table.rowSpan(k) - 1, table.col(k) + table.colSpan(k) - 1);
+        merges += "\"/>";
+        ++merge_count;
+    }
+    if (merge_count > 0)
+        xml += "<mergeCells count=\"" + std::to_string(merge_count) + "\">" + merges + "</mergeCells>";
+    xml += "</worksheet>";
+    return xml;
+}
+
+// 工作表名称不能超过31个字符, 不能包含 []:*?/\, 且不能重复(不区分大小写).
+// 同时也用作批量导出的文件名, 因此一并去除文件名中不允许的字符
+std::vector<QString> sheetNames(const std::vector<ExportSheet> &sheets)
+{
+    std::vector<QString> names;
+    for (size_t i = 0; i < sheets.size(); ++i)
+    {
+        QString name = sheets[i].name;
+        static const QRegularExpression invalid("[\\[\\]:*?/\\\\\"<>|]");
+        name.remove(invalid);
+        name = name.left(31).trimmed();
+        if (name.isEmpty())
+            name = QString("Sheet%1").arg(i + 1);
+        QString unique = name;
+        // Excel 的工作表名称及 Windows 文件名不区分大小写
+        auto taken = [&](const QString &candidate) {
+            return std::any_of(names.begin(), names.end(), [&](const QString &used) {
+                return used.compare(candidate, Qt::CaseInsensitive) == 0;
+                });
+        };
+        for (int n = 2; taken(unique); ++n)
+        {
+            QString suffix = QString("(%1)").arg(n);
+            unique = name.left(31 - suffix.size()) + suffix;
+        }
+        names.push_back(unique);
+    }
+    return names;
+}
+
+void writeXlsx(FileSink &out, const std::vector<ExportSheet> &sheets)
+{
+    const std::vector<QString> names = sheetNames(sheets);
+    std::string types = "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+        "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>"
+        "<Default Extension=\"xml\" ContentType=\"application/xml\"/>"
+        "<Override PartName=\"/xl/workbook.xml\" "
+        "ContentType=\"application/vnd.openxmlformats-officedocument.spreadsheetml.sheet.main+xml\"/>";
+    std::string workbook = "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<workbook xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\" "
+        "xmlns:r=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships\"><sheets>";
+    std::string workbook_rels = "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">";
+    for (size_t i = 0; i < sheets.size(); ++i)
+    {
+        std::string n = std::to_string(i + 1);
+        types += "<Override PartName=\"/xl/worksheets/sheet" + n + ".xml\" "
+            "ContentType=\"application/vnd.openxmlformats-officedocument.spreadsheetml.worksheet+xml\"/>";
+        workbook += "<sheet name=\"";
+        appendXml(workbook, names[i].toStdString());
+        workbook += "\" sheetId=\"" + n + "\" r:id=\"rId" + n + "\"/>";
+        workbook_rels += "<Relationship Id=\"rId" + n + "\" "
+            "Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/worksheet\" "
+            "Target=\"worksheets/sheet" + n + ".xml\"/>";
+    }
+    types += "</Types>";
+    workbook += "</sheets></workbook>";
+    workbook_rels += "</Relationships>";
+
+    ZipWriter zip(out);
+    zip.add("[Content_Types].xml", types);
+    zip.add("_rels/.rels", "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+        "<Relationship Id=\"rId1\" "
+        "Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/officeDocument\" "
+        "Target=\"xl/workbook.xml\"/></Relationships>");
+    zip.add("xl/workbook.xml", workbook);
+    zip.add("xl/_rels/workbook.xml.rels", workbook_rels);
+    // 逐个生成工作表, 同一时刻只有一个工作表的内容在内存中
+    for (size_t i = 0; i < sheets.size(); ++i)
+        zip.add("xl/worksheets/sheet" + std::to_string(i + 1) + ".xml", sheetXml(*sheets[i].table));
+    zip.finish();
+}
+
+/******************************** JSON ********************************/
+
+void writeJsonString(FileSink &out, std::string_view text)
+{
+    static const char hex[] = "0123456789abcdef";
+    out.put('"');
+    for (char c : text)
+    {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\')
+        {
+            out.put('\\');
+            out.put(c);
+        }
+        else if (u < 0x20)
+        {
+            out.write("\\u00");
+            out.put(hex[u >> 4]);
+            out.put(hex[u & 0xF]);
+        }
+        else
+        {
+            out.put(c);
+        }
+    }
+    out.put('"');
+}
+
+// 按列写出所有表格的单元格, 每一列依次遍历所有单元格
+void writeJson(FileSink &out, const std::vector<ExportSheet> &sheets)
+{
+    size_t count = 0;
+    for (const auto &sheet : sheets)
+        count += sheet.table->size();
+
+    auto column = [&](const char *name, bool first, auto &&value) {
+        if (!first)
+            out.put(',');
+        out.write("\n    \"");
+        out.write(name);
+        out.write("\": [");
+        bool first_value = true;
+        for (const auto &sheet : sheets)
+        {
+            for (int k = 0; k < sheet.table->size(); ++k)
+            {
+                if (!first_value)
+                    out.put(',');
+                first_value = false;
+                value(sheet, k);
+            }
+        }
+        out.put(']');
+    };
+    auto number = [&](int v) { out.write(std::to_string(v)); };
+
+    out.write("{\n  \"format\": \"qcr-columnar\",\n  \"count\": ");
+    out.write(std::to_string(count));
+    out.write(",\n  \"columns\": {");
+    column("sheet", true, [&](const ExportSheet &s, int) { writeJsonString(out, s.name.toStdString()); });
+    column("row", false, [&](const ExportSheet &s, int k) { number(s.table->row(k)); });
+    column("col", false, [&](const ExportSheet &s, int k) { number(s.table->col(k)); });
+    column("row_span", false, [&](const ExportSheet &s, int k) { number(s.table->rowSpan(k)); });
+    column("col_span", false, [&](const ExportSheet &s, int k) { number(s.table->colSpan(k)); });
+    column("text", false, [&](const ExportSheet &s, int k) { writeJsonString(out, s.table->text(k)); });
+    column("left", false, [&](const ExportSheet &s, int k) { number(s.table->rect(k).left); });
+    column("top", false, [&](const ExportSheet &s, int k) { number(s.table->rect(k).top); });
+    column("right", false, [&](const ExportSheet &s, int k) { number(s.table->rect(k).right); });
+    column("bottom", false, [&](const ExportSheet &s, int k) { number(s.table->rect(k).bottom); });
+    out.write("\n  }\n}\n");
+}
+
+bool writeFile(const std::vector<ExportSheet> &sheets, const QString &path,
+    const ExportOptions &options, bool with_sheet_column, QString &error)
+{
+    FileSink out(path, options.format == ExportFormat::Csv ? options.encoding : ExportEncoding::Utf8);
+    if (!out.ok())
+    {
+        error = QString::fromUtf8(u8"无法写入文件 %1: %2").arg(path, out.errorString());
+        return false;
+    }
+    switch (options.format)
+    {
+    case ExportFormat::Csv:
+        for (const auto &sheet : sheets)
+        {
+            std::string name = sheet.name.toStdString();
+            writeCsv(out, *sheet.table, with_sheet_column ? &name : nullptr);
+        }
+        break;
+    case ExportFormat::Xlsx:
+        writeXlsx(out, sheets);
+        break;
+    case ExportFormat::Json:
+        writeJson(out, sheets);
+        break;
+    }
+    if (!out.close())
+    {
+        error = QString::fromUtf8(u8"写入文件失败 %1: %2").arg(path, out.errorString());
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+QString exportSuffix(ExportFormat format)
+{
+    switch (format)
+    {
+    case ExportFormat::Xlsx:
+        return "xlsx";
+    case ExportFormat::Json:
+        return "json";
+    default:
+        return "csv";
+    }
+}
+
+bool exportTable(const TableModel &table, const QString &path,
+    const ExportOptions &options, QString &error)
+{
+    return writeFile({ { QString("Sheet1"), &table } }, path, options, false, error);
+}
+
+bool exportSheets(const std::vector<ExportSheet> &sheets, const QString &path,
+    const ExportOptions &options, bool single_file, QString &error)
+{
+    if (single_file)
+        return writeFile(sheets, path, options, true, error);
+
+    QDir dir(path);
+    if (!dir.exists() && !dir.mkpath("."))
+    {
+        error = QString::fromUtf8(u8"无法创建目录: %1").arg(path);
+        return false;
+    }
+    const std::vector<QString> names = sheetNames(sheets);
+    for (size_t i = 0; i < sheets.size(); ++i)
+    {
+        QString file = dir.filePath(names[i] + "." + exportSuffix(options.format));
+        if (!writeFile({ sheets[i] }, file, options, false, error))
+            return false;
+    }
+    return true;
+}
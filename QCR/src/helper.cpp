@@ -6,17 +6,60 @@
 
 #include <opencv2/opencv.hpp>
 #include <spdlog/spdlog.h>
+#include <spdlog/async.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
-#include <spdlog/sinks/basic_file_sink.h>
+#include <spdlog/sinks/daily_file_sink.h>
 
 #include <algorithm> // for std::min
+#include <chrono>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
 
 #include <include/base64.h>
 #include <include/helper.h>
+#include "include/morphology.h"
 
 std::shared_ptr<spdlog::logger> qcr_file_logger;
 std::shared_ptr<spdlog::logger> qcr_console_logger;
 
+namespace
+{
+
+// 异步日志队列长度, 队列满时阻塞调用线程, 不丢弃日志
+constexpr size_t LOG_QUEUE_SIZE = 8192;
+// 日志文件保留天数
+constexpr uint16_t LOG_MAX_FILES = 30;
+// 控制台显示的数据最大长度, 完整内容只以 debug 级别写入文件
+constexpr size_t PAYLOAD_CONSOLE_LEN = 512;
+
+// 按天分割的日志文件名, 与原来一致: log/2021-03-11.log
+struct DateLogName
+{
+    static spdlog::filename_t calc_filename(const spdlog::filename_t &filename, const tm &now_tm)
+    {
+        char date[16];
+        std::strftime(date, sizeof(date), "%Y-%m-%d", &now_tm);
+        return filename + date + ".log";
+    }
+};
+
+void writeLog(spdlog::level::level_enum level, const std::string &log, bool save)
+{
+    qcr_console_logger->log(level, log);
+    if (save)
+        qcr_file_logger->log(level, log);
+}
+
+bool shouldLog(spdlog::level::level_enum level, bool save)
+{
+    return qcr_console_logger->should_log(level) || (save && qcr_file_logger->should_log(level));
+}
+
+}  // namespace
+
 
 QString getCurTimeString()
 {
@@ -28,11 +71,35 @@ bool initSpdLogger()
 {
     try
     {
+#ifdef _WIN32
+        // 日志统一使用 UTF-8, 控制台也按 UTF-8 输出, 不再为控制台单独转换编码
+        SetConsoleOutputCP(CP_UTF8);
+#endif
+        // 写日志只是入队, 由后台线程格式化并写入, 定期刷新到文件
+        spdlog::init_thread_pool(LOG_QUEUE_SIZE, 1);
+        auto console_sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+        auto file_sink = std::make_shared<spdlog::sinks::daily_file_sink<std::mutex, DateLogName>>(
+            "log/", 0, 0, false, LOG_MAX_FILES);
+        qcr_console_logger = std::make_shared<spdlog::async_logger>("qcr_console_logger", console_sink,
+            spdlog::thread_pool(), spdlog::async_overflow_policy::block);
+        qcr_file_logger = std::make_shared<spdlog::async_logger>("qcr_file_logger", file_sink,
+            spdlog::thread_pool(), spdlog::async_overflow_policy::block);
+        spdlog::register_logger(qcr_console_logger);
+        spdlog::register_logger(qcr_file_logger);
+
+        // 日志级别, 可以通过环境变量 QCR_LOG_LEVEL 修改, 如 debug、warn
+        // 无法识别的名称 from_str 会返回 off, 此时仍使用 info, 避免关闭所有日志
+        const char *env = std::getenv("QCR_LOG_LEVEL");
+        spdlog::level::level_enum level = env ? spdlog::level::from_str(env) : spdlog::level::info;
+        bool unknown = env && level == spdlog::level::off && std::string(env) != "off";
+        if (unknown)
+            level = spdlog::level::info;
+        spdlog::set_level(level);
         spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%t] %v");
-        QString date = QDate::currentDate().toString("yyyy-MM-dd");
-        std::string log_file = "log/" + date.toLocal8Bit() + ".log";
-        qcr_file_logger = spdlog::basic_logger_mt("qcr_file_logger", log_file);
-        qcr_console_logger = spdlog::stdout_color_mt("qcr_console_logger");
+        spdlog::flush_every(std::chrono::seconds(3));
+        spdlog::flush_on(spdlog::level::warn);
+        if (unknown)
+            writeLog(spdlog::level::warn, std::string("unknown QCR_LOG_LEVEL '") + env + "', using info", true);
     }
     catch (const spdlog::spdlog_ex &ex)
     {
@@ -42,58 +109,78 @@ bool initSpdLogger()
     return true;
 }
 
-void printLog(const QString &log, bool save)
+void closeSpdLogger()
 {
-    qcr_console_logger->info(log.toLocal8Bit().toStdString());
-    qcr_console_logger->flush();
-    if (save)
+    // 等待队列中的日志写完
+    spdlog::shutdown();
+}
+
+void cleanLog()
+{
+    printLog(QString::fromUtf8(u8"开始清理超过%1天的日志文件").arg(LOG_MAX_FILES));
+    QDir dir("log");
+    if (!dir.exists())
+        return;
+    QFileInfoList ls = dir.entryInfoList(QStringList({ "*-*-*.log" }), QDir::Files);
+    for (auto &info : ls)
     {
-        qcr_file_logger->info(log.toUtf8().toStdString());
-        qcr_file_logger->flush();
+        QDate date = QDate::fromString(info.completeBaseName(), "yyyy-MM-dd");
+        if (date.isValid() && date.daysTo(QDate::currentDate()) > LOG_MAX_FILES)
+        {
+            printLog(QString::fromUtf8(u8"删除: ") + info.fileName());
+            QFile::remove(info.absoluteFilePath());
+        }
     }
+    printLog(QString::fromUtf8(u8"日志清理完毕"));
+}
+
+void printLog(const QString &log, bool save)
+{
+    // 未启用的级别直接返回, 不做编码转换
+    if (!shouldLog(spdlog::level::info, save))
+        return;
+    writeLog(spdlog::level::info, log.toUtf8().toStdString(), save);
 }
 
 void printLog(const std::string &log, bool save)
 {
-    qcr_console_logger->info(log);
-    qcr_console_logger->flush();
-    if (save)
-    {
-        qcr_file_logger->info(log);
-        qcr_file_logger->flush();
-    }
+    writeLog(spdlog::level::info, log, save);
 }
 
 void printLog(const char *log, bool save)
 {
-    qcr_console_logger->info(log);
-    if (save)
+    writeLog(spdlog::level::info, log, save);
+}
+
+void printPayload(const std::string &tag, const std::string &payload)
+{
+    if (shouldLog(spdlog::level::info, false) && payload.size() > PAYLOAD_CONSOLE_LEN)
+    {
+        qcr_console_logger->info("{}: {}... ({} bytes)", tag,
+            std::string_view(payload.data(), PAYLOAD_CONSOLE_LEN), payload.size());
+    }
+    else
     {
-        qcr_file_logger->info(log);
+        qcr_console_logger->info("{}: {}", tag, payload);
     }
+    qcr_file_logger->debug("{}: {}", tag, payload);
 }
 
-void cleanLog()
+void recordFixture(const QString &name, const char *suffix, const std::string &payload)
 {
-    printLog(QString::fromUtf8(u8"开始清理超过30天的日志文件"));
-    QDir dir("log");
-    if (!dir.exists())
+    static const char *dir = std::getenv("QCR_RECORD_FIXTURES");
+    if (!dir || !*dir || name.isEmpty())
         return;
-    QFileInfoList ls = dir.entryInfoList(QStringList({ "*-*-*.log" }), QDir::Files);
-    for (auto &info : ls)
+    QDir().mkpath(QString::fromLocal8Bit(dir));
+    QString path = QDir(QString::fromLocal8Bit(dir)).filePath(QString("%1.%2.json").arg(name, suffix));
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
     {
-        QStringList d = info.baseName().split('-');
-        int year = d[0].toInt();
-        int month = d[1].toInt();
-        int day = d[2].toInt();
-        int days = QDate(year, month, day).daysTo(QDate::currentDate());
-        if (days > 30)
-        {
-            printLog(QString::fromUtf8(u8"删除: ") + info.fileName());
-            QFile::remove(info.absoluteFilePath());
-        }
+        writeLog(spdlog::level::warn, QString::fromUtf8(u8"无法写入录制数据: %1").arg(path).toUtf8().toStdString(), true);
+        return;
     }
-    printLog(QString::fromUtf8(u8"日志清理完毕"));
+    file.write(payload.data(), static_cast<qint64>(payload.size()));
+    printLog(QString::fromUtf8(u8"已录制识别结果: %1").arg(path));
 }
 
 void calAveSd(const std::vector<double> &vec, double &ave, double &sd)
@@ -108,10 +195,12 @@ void calAveSd(const std::vector<double> &vec, double &ave, double &sd)
 
 void calAveSd(const std::vector<int> &vec, double &ave, double &sd)
 {
-    std::vector<double> v;
-    for (auto val : vec)
-        v.push_back(static_cast<double>(val));
-    return calAveSd(v, ave, sd);
+    if (vec.empty())
+        return;
+    int n = vec.size();
+    ave = std::accumulate(vec.begin(), vec.end(), 0.0) / n;
+    sd = std::sqrt(std::accumulate(vec.begin(), vec.end(), 0.0,
+        [=](double sum, int d) { return sum + (d - ave) * (d - ave); }) / n);
 }
 
 std::string get_data(const int64_t &timestamp)
@@ -285,6 +374,14 @@ std::vector<std::vector<cv::Point>> recognizeTable(const cv::String path)
         printLog("Error opening image.");
         return std::vector<std::vector<cv::Point>>();
     }
+    TableLines lines;
+    recognizeTable(mat, lines);
+    return lines.points;
+}
+
+bool recognizeTable(const cv::Mat &mat, TableLines &table_lines)
+{
+    table_lines = TableLines();
 
     // 检查是否为灰度图，如果不是，转化为灰度图
     cv::Mat proc = mat.clone();
@@ -306,14 +403,14 @@ std::vector<std::vector<cv::Point>> recognizeTable(const cv::String path)
     cv::Mat struct_square = cv::getStructuringElement(
         cv::MORPH_RECT, cv::Size(3, 3));
     dilate(proc, proc, struct_square);
+    table_lines.binary = proc;
 
     // 形态学, 保留较长的横竖线条
     // 黑底白字, 腐蚀掉白字
-    cv::Mat struct_h = cv::getStructuringElement(
-        cv::MORPH_RECT, cv::Size(30, 1));
     cv::Mat mat_h;
-    erode(proc, mat_h, struct_h, cv::Size(-1, -1), 2);
-    dilate(mat_h, mat_h, struct_h, cv::Size(-1, -1), 2);
+    erodeLine(proc, mat_h, 30, true, 2);
+    dilateLine(mat_h, mat_h, 30, true, 2);
+    table_lines.mask_h = mat_h;
 
     // 边缘检测
     cv::Mat canny_h;
@@ -325,11 +422,10 @@ std::vector<std::vector<cv::Point>> recognizeTable(const cv::String path)
     std::vector<cv::Vec3d> lines_h = mergeLines(h_lines, true);
     printLog("rows = " + std::to_string(lines_h.size()));
 
-    cv::Mat struct_v = cv::getStructuringElement(
-        cv::MORPH_RECT, cv::Size(1, 30));
     cv::Mat mat_v;
-    erode(proc, mat_v, struct_v, cv::Size(-1, -1), 2);
-    dilate(mat_v, mat_v, struct_v, cv::Size(-1, -1), 2);
+    erodeLine(proc, mat_v, 30, false, 2);
+    dilateLine(mat_v, mat_v, 30, false, 2);
+    table_lines.mask_v = mat_v;
 
     // 边缘检测
     cv::Mat canny_v;
@@ -406,13 +502,18 @@ std::vector<std::vector<cv::Point>> recognizeTable(const cv::String path)
     * p4 p5 p6
     * p7 p8 p9
     */
-    return transpose(points_matrix);
+    if (points_matrix.empty())
+        return false;
+    table_lines.points = transpose(points_matrix);
+    return true;
 }
 
 std::vector<cv::Vec3d> mergeLines(std::vector<cv::Vec4i> &lines, bool horizontal)
 {
     // 返回值 (A, B, C), 直线一般方程参数: Ax + By + C = 0
     std::vector<cv::Vec3d> ret;
+    if (lines.empty())
+        return ret;
     std::sort(lines.begin(), lines.end(),
         [=](const cv::Vec4i &l1, const cv::Vec4i &l2) {
             return horizontal ? l1[1] < l2[1] : l1[0] < l2[0];
@@ -452,6 +553,42 @@ std::vector<cv::Vec3d> mergeLines(std::vector<cv::Vec4i> &lines, bool horizontal
     return ret;
 }
 
+namespace
+{
+
+// 归一化的直线一般方程 Ax + By + C = 0, A^2 + B^2 = 1, 点到直线的距离即 |Ax + By + C|
+struct NormLine
+{
+    double a, b, c;
+
+    explicit NormLine(const cv::Vec3d &l)
+    {
+        double n = std::sqrt(l[0] * l[0] + l[1] * l[1]);
+        a = l[0] / n;
+        b = l[1] / n;
+        c = l[2] / n;
+    }
+
+    double dist(const cv::Point &p) const { return std::abs(a * p.x + b * p.y + c); }
+    // 竖线在纵坐标 y 处的横坐标
+    double xAt(double y) const { return -(b * y + c) / a; }
+    // 横线在横坐标 x 处的纵坐标
+    double yAt(double x) const { return -(a * x + c) / b; }
+};
+
+/*
+* 在按位置排序的直线中二分查找 pos 所在的位置, 返回第一条位于 pos 之后的直线,
+* at(line) 为直线在点处的坐标
+*/
+template <typename F>
+size_t lowerLine(const std::vector<NormLine> &lines, double pos, F at)
+{
+    return std::partition_point(lines.begin(), lines.end(),
+        [&](const NormLine &l) { return at(l) < pos; }) - lines.begin();
+}
+
+}  // namespace
+
 std::vector<std::vector<cv::Point>> formatPointMatrix(
     std::vector<cv::Point> points_list,
     const std::vector<cv::Vec3d> &lines_h,
@@ -468,114 +605,104 @@ std::vector<std::vector<cv::Point>> formatPointMatrix(
         return matrix;
     }
 
-    // 按横坐标 x 排序
-    std::sort(points_list.begin(), points_list.end(),
-        [](const cv::Point &p1, const cv::Point &p2) {
-            return p1.x < p2.x;
-        });
+    // 预先归一化, 横线按纵坐标、竖线按横坐标排序(mergeLines 的输出已经有序)
+    std::vector<NormLine> hs(lines_h.begin(), lines_h.end());
+    std::vector<NormLine> vs(lines_v.begin(), lines_v.end());
 
-    // 找出同一列的点, 一般两列之间间距大一些便于区分
-    for (auto &v : lines_v)
+    // 1. 每个点归入距离20像素以内的竖线, 有多条时取最左边的一条.
+    // 二分查找点所在位置, 只需检查附近的竖线
+    std::vector<std::vector<cv::Point>> columns(cols);
+    for (const auto &p : points_list)
     {
-        // 1. 找出距离一条竖线一定范围内的点, 认为是同一列的点
-        std::vector<cv::Point> vec;
-        double A = v[0];
-        double B = v[1];
-        double C = v[2];
-        size_t i = 0;
-        while (i != points_list.size())
-        {
-            cv::Point p = points_list[i];
-            double d = abs(A * p.x + B * p.y + C) / sqrt(A * A + B * B);
-            if (d < 20)
-            {
-                vec.push_back(p);
-                points_list.erase(points_list.begin() + i);
-                continue;
-            }
-            ++i;
-        }
+        size_t k = lowerLine(vs, p.x, [&](const NormLine &l) { return l.xAt(p.y); });
+        int best = -1;
+        for (size_t i = k; i-- > 0 && vs[i].dist(p) < 20;)
+            best = static_cast<int>(i);
+        if (best < 0 && k < vs.size() && vs[k].dist(p) < 20)
+            best = static_cast<int>(k);
+        if (best >= 0)
+            columns[best].push_back(p);
+    }
+
+    for (int j = 0; j < cols; ++j)
+    {
+        std::vector<cv::Point> &vec = columns[j];
         // 按纵坐标 y 从小到大排序
         std::sort(vec.begin(), vec.end(),
             [](const cv::Point &p1, const cv::Point &p2) {
                 return p1.y < p2.y;
             });
 
-        // 2. 这一列点的数量大于横线数, 即存在多余点, 需要删除
+        // 2. 这一列点的数量大于横线数, 即存在多余点, 需要删除.
+        // 依次为每条横线保留距离最近的剩余点. 剩余点按纵坐标有序地保存在链表中,
+        // 横线自上而下处理, 游标只向下移动, 每次只需比较游标前后两个点
         if (vec.size() > rows)
         {
-            std::vector<cv::Point> copy = vec;
-            vec.clear();
+            const int n = static_cast<int>(vec.size());
+            std::vector<int> prev(n);
+            std::vector<int> next(n);
+            for (int i = 0; i < n; ++i)
+            {
+                prev[i] = i - 1;
+                next[i] = i + 1;
+            }
+            int tail = n - 1;
+            int cur = 0;  // 第一个不在当前横线上方的剩余点, n 表示没有
 
-            // 对每条横线找距离最近的点并保留, 遍历完所有横线后剩余的点丢弃
-            for (auto &ll : lines_h)
+            std::vector<cv::Point> kept;
+            kept.reserve(rows);
+            for (const auto &h : hs)
             {
-                double AA = ll[0];
-                double BB = ll[1];
-                double CC = ll[2];
-                // 距离横线ll最近的点的索引
-                size_t min_index = 0;
-                double dist = abs(AA * copy[0].x + BB * copy[0].y + CC)
-                    / sqrt(AA * AA + BB * BB);
-
-                size_t i = 1;
-                while (i != copy.size())
-                {
-                    double dd = abs(AA * copy[i].x + BB * copy[i].y + CC)
-                        / sqrt(AA * AA + BB * BB);
-                    if (dd < dist)
-                    {
-                        min_index = i;
-                        dist = dd;
-                    }
-                    ++i;
-                }
-                vec.push_back(copy[min_index]);
-                copy.erase(copy.begin() + min_index);
+                while (cur != n && vec[cur].y < h.yAt(vec[cur].x))
+                    cur = next[cur];
+                int before = cur == n ? tail : prev[cur];
+                int best = cur;
+                if (before >= 0 && (cur == n || h.dist(vec[before]) <= h.dist(vec[cur])))
+                    best = before;
+
+                kept.push_back(vec[best]);
+                // 从链表中删除
+                if (prev[best] >= 0)
+                    next[prev[best]] = next[best];
+                if (next[best] < n)
+                    prev[next[best]] = prev[best];
+                else
+                    tail = prev[best];
+                if (best == cur)
+                    cur = next[best];
             }
+            vec.swap(kept);
         }
 
         // 3. 点的数量小于行数, 即缺失部分点, 需要补全
         else if (vec.size() < rows)
         {
-            std::vector<cv::Point> copy = vec;
-            vec.clear();
-            vec.resize(rows, cv::Point(-1. - 1));
+            std::vector<cv::Point> copy;
+            copy.swap(vec);
+            vec.resize(rows, cv::Point(-1, -1));
+            std::vector<bool> found(rows, false);
 
             // 把已有的点填到距离最近的横线的行数
             for (auto &p : copy)
             {
-                size_t min_index = 0;
-                double dist = abs(lines_h[0][0] * p.x + lines_h[0][1] * p.y + lines_h[0][2])
-                    / sqrt(lines_h[0][0] * lines_h[0][0] + lines_h[0][1] * lines_h[0][1]);
-                size_t i = 0;
-                while (i != lines_h.size())
-                {
-                    double AA = lines_h[i][0];
-                    double BB = lines_h[i][1];
-                    double CC = lines_h[i][2];
-                    double dd = abs(AA * p.x + BB * p.y + CC)
-                        / sqrt(AA * AA + BB * BB);
-                    if (dd < dist)
-                    {
-                        min_index = i;
-                        dist = dd;
-                    }
-                    ++i;
-                }
+                size_t k = lowerLine(hs, p.y, [&](const NormLine &l) { return l.yAt(p.x); });
+                size_t min_index = k < hs.size() ? k : k - 1;
+                if (k > 0 && k < hs.size() && hs[k - 1].dist(p) <= hs[k].dist(p))
+                    min_index = k - 1;
                 vec[min_index] = p;
+                found[min_index] = true;
             }
 
             // 缺失的点用两直线交点补齐
+            const NormLine &v = vs[j];
             for (size_t i = 0; i < vec.size(); ++i)
             {
-                if (vec[i] == cv::Point(-1. - 1))
+                if (!found[i])
                 {
-                    double A2 = lines_h[i][0];
-                    double B2 = lines_h[i][1];
-                    double C2 = lines_h[i][2];
-                    int x0 = static_cast<int>((B * B2 - B2 * C) / (B2 * A - B * A2));
-                    int y0 = static_cast<int>((A * C2 - C * A2) / (B * A2 - A * B2));
+                    const NormLine &h = hs[i];
+                    double det = v.a * h.b - h.a * v.b;
+                    int x0 = static_cast<int>((v.b * h.c - h.b * v.c) / det);
+                    int y0 = static_cast<int>((h.a * v.c - v.a * h.c) / det);
                     vec[i] = { x0, y0 };
                 }
             }
@@ -611,17 +738,13 @@ void removeText(const cv::Mat &src)
 
     // 形态学, 保留较长的横竖线条
     // 黑底白字, 腐蚀掉白字
-    cv::Mat struct_h = cv::getStructuringElement(
-        cv::MORPH_RECT, cv::Size(30, 1));
     cv::Mat mat_h;
-    erode(proc, mat_h, struct_h, cv::Size(-1, -1), 2);
-    dilate(mat_h, mat_h, struct_h, cv::Size(-1, -1), 2);
+    erodeLine(proc, mat_h, 30, true, 2);
+    dilateLine(mat_h, mat_h, 30, true, 2);
 
-    cv::Mat struct_v = cv::getStructuringElement(
-        cv::MORPH_RECT, cv::Size(1, 30));
     cv::Mat mat_v;
-    erode(proc, mat_v, struct_v, cv::Size(-1, -1), 2);
-    dilate(mat_v, mat_v, struct_v, cv::Size(-1, -1), 2);
+    erodeLine(proc, mat_v, 30, false, 2);
+    dilateLine(mat_v, mat_v, 30, false, 2);
 
     cv::Mat mat_table;
     bitwise_or(mat_h, mat_v, mat_table);
@@ -636,6 +759,8 @@ template<typename T>
 std::vector<std::vector<T>> transpose(std::vector<std::vector<T>> &vec)
 {
     std::vector<std::vector<T>> trans;
+    if (vec.empty())
+        return trans;
     for (int i = 0; i < vec[0].size(); ++i)
     {
         std::vector<T> v;
@@ -0,0 +1,80 @@
+﻿#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#include "include/image_pyramid.h"
+#include "include/helper.h"
+
+ImagePyramid::ImagePyramid(int cache_mb)
+{
+    tiles_.setMaxCost(cache_mb * 1024);
+}
+
+void ImagePyramid::setImage(const cv::Mat &img)
+{
+    clear();
+    if (img.empty())
+        return;
+    levels_.push_back(img);
+    while (std::max(levels_.back().cols, levels_.back().rows) > TILE_SIZE)
+    {
+        cv::Mat down;
+        cv::pyrDown(levels_.back(), down);
+        levels_.push_back(down);
+    }
+}
+
+void ImagePyramid::clear()
+{
+    levels_.clear();
+    tiles_.clear();
+}
+
+const cv::Mat &ImagePyramid::image() const
+{
+    static const cv::Mat empty;
+    return levels_.empty() ? empty : levels_.front();
+}
+
+QSize ImagePyramid::size() const
+{
+    return levelSize(0);
+}
+
+QSize ImagePyramid::levelSize(int level) const
+{
+    if (level < 0 || level >= levelCount())
+        return QSize();
+    return QSize(levels_[level].cols, levels_[level].rows);
+}
+
+int ImagePyramid::levelFor(double zoom) const
+{
+    if (levels_.empty() || zoom >= 1.0)
+        return 0;
+    int level = static_cast<int>(std::floor(std::log2(1.0 / zoom)));
+    return std::min(std::max(level, 0), levelCount() - 1);
+}
+
+QPixmap ImagePyramid::tile(int level, int tx, int ty)
+{
+    if (level < 0 || level >= levelCount())
+        return QPixmap();
+    quint64 key = (static_cast<quint64>(level) << 48) | (static_cast<quint64>(ty) << 24)
+        | static_cast<quint64>(tx);
+    if (QPixmap *pix = tiles_.object(key))
+        return *pix;
+
+    const cv::Mat &mat = levels_[level];
+    cv::Rect rect = cv::Rect(tx * TILE_SIZE, ty * TILE_SIZE, TILE_SIZE, TILE_SIZE)
+        & cv::Rect(0, 0, mat.cols, mat.rows);
+    if (rect.empty())
+        return QPixmap();
+    // QPixmap::fromImage 会复制数据, 不需要先复制子图
+    QPixmap *pix = new QPixmap(cvMatToQPixmap(mat(rect)));
+    QPixmap result = *pix;
+    int cost = std::max(1, pix->width() * pix->height() * pix->depth() / 8 / 1024);
+    tiles_.insert(key, pix, cost);
+    return result;
+}
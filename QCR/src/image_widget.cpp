@@ -1,9 +1,26 @@
 ﻿#include "include/image_widget.h"
 
 #include <QPainter>
+#include <QPaintEvent>
+
+#include <opencv2/core.hpp>
+
+#include <cmath>
+
+namespace
+{
+
+// 最大放大倍数
+constexpr double MAX_ZOOM = 8.0;
+// 滚轮每一格的缩放倍数
+constexpr double WHEEL_STEP = 1.25;
+
+}  // namespace
 
 ImageWidget::ImageWidget(QWidget *parent) : QFrame(parent)
 {
+    // 只设置一次, 在 paintEvent 中设置会导致每次重绘都重新计算样式
+    this->setStyleSheet("border:1px solid grey");  // 边框样式
 }
 
 ImageWidget::~ImageWidget()
@@ -12,63 +29,116 @@ ImageWidget::~ImageWidget()
 
 void ImageWidget::mousePressEvent(QMouseEvent *event)
 {
+    if (pyramid.isNull())
+        return;
     QPoint p = event->pos();
     inVertex(p);
     if (vertex_index != -1)
     {
-        intercept_abs[vertex_index] = p;
-        abs2rel();
-        update();
+        moveVertex(p);
+    }
+    else if (event->button() == Qt::LeftButton)
+    {
+        panning = true;
+        pan_pos = p;
+        setCursor(Qt::ClosedHandCursor);
     }
 }
 
 void ImageWidget::mouseMoveEvent(QMouseEvent *event)
 {
+    if (panning)
+    {
+        offset += event->pos() - pan_pos;
+        pan_pos = event->pos();
+        clampOffset();
+        update();
+        return;
+    }
     updatePos(event->pos());
 }
 
 void ImageWidget::mouseReleaseEvent(QMouseEvent *event)
 {
+    if (panning)
+    {
+        panning = false;
+        unsetCursor();
+        return;
+    }
     updatePos(event->pos());
     vertex_index = -1;
 }
 
+void ImageWidget::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    if (pyramid.isNull() || vertex_index != -1)
+        return;
+    // 在适应窗口和原始大小之间切换, 原始大小时以双击位置为中心
+    if (fit_mode)
+        zoomAt(event->pos(), 1.0);
+    else
+        fitToWindow();
+    update();
+}
+
+void ImageWidget::wheelEvent(QWheelEvent *event)
+{
+    if (pyramid.isNull())
+        return;
+    double steps = event->angleDelta().y() / 120.0;
+    if (steps == 0)
+        return;
+    zoomAt(event->position(), zoom * std::pow(WHEEL_STEP, steps));
+    update();
+}
+
 void ImageWidget::paintEvent(QPaintEvent *event)
 {
-    this->setStyleSheet("border:1px solid grey");  // 边框样式
     QPainter painter(this);
-    if (!src_pix.isNull())
+    if (!pyramid.isNull())
     {
-        drawImage(painter);
+        drawImage(painter, event->rect());
         drawInterceptBox(painter);
         drawSelectedRect(painter);
     }
 }
 
-void ImageWidget::setPix(QPixmap pix)
+void ImageWidget::resizeEvent(QResizeEvent *event)
+{
+    if (fit_mode)
+        fitToWindow();
+    else
+        clampOffset();
+    QFrame::resizeEvent(event);
+}
+
+void ImageWidget::setImage(const cv::Mat &img)
 {
     initial = true;
-    this->src_pix = pix;
+    pyramid.setImage(img);
+    fitToWindow();
     this->update();
 }
 
-QPixmap ImageWidget::getPix()
+const cv::Mat &ImageWidget::image() const
 {
-    return src_pix;
+    return pyramid.image();
 }
 
 void ImageWidget::getSize(int &width, int &height)
 {
-    width = src_pix.width();
-    height = src_pix.height();
+    width = pyramid.size().width();
+    height = pyramid.size().height();
 }
 
 void ImageWidget::rotateImage()
 {
-    // 旋转图片
-    QTransform trans;
-    trans.rotate(90);
-    this->src_pix = this->src_pix.transformed(trans);
+    // 旋转图片, 与 QTransform::rotate(90) 方向相同
+    cv::Mat rotated;
+    cv::rotate(pyramid.image(), rotated, cv::ROTATE_90_CLOCKWISE);
+    pyramid.setImage(rotated);
+    fitToWindow();
 
     // 旋转截取框
     QPointF tmp = intercept_rel[3];
@@ -110,9 +180,7 @@ void ImageWidget::abs2rel()
     intercept_rel.clear();
     for (const auto &p : intercept_abs)
     {
-        double _x = static_cast<double>(p.x() - h_margin) / scaled_pix.width();
-        double _y = static_cast<double>(p.y() - v_margin) / scaled_pix.height();
-        intercept_rel.append(QPointF(_x, _y));
+        intercept_rel.append(widgetToRel(p));
     }
 }
 
@@ -121,9 +189,7 @@ void ImageWidget::rel2abs()
     intercept_abs.clear();
     for (const auto &p : intercept_rel)
     {
-        int _x = h_margin + p.x() * scaled_pix.width();
-        int _y = v_margin + p.y() * scaled_pix.height();
-        intercept_abs.append(QPoint(_x, _y));
+        intercept_abs.append(relToWidget(p).toPoint());
     }
 }
 
@@ -132,25 +198,38 @@ void ImageWidget::updatePos(const QPoint &p)
     if (vertex_index != -1)
     {
         if (isOk(p))
-        {
-            intercept_abs[vertex_index] = p;
-            abs2rel();
-            update();
-        }
+            moveVertex(p);
         //else
         //    intercept_abs[vertex_index] = getPedal(p);
     }
 }
 
+QRect ImageWidget::vertexDirtyRect(int index) const
+{
+    const int n = intercept_abs.size();
+    QPolygon polygon;
+    polygon << intercept_abs[(index + n - 1) % n] << intercept_abs[index] << intercept_abs[(index + 1) % n];
+    // 圆圈半径及画笔宽度
+    const int margin = CIRCLE_SIZE + 4;
+    return polygon.boundingRect().adjusted(-margin, -margin, margin, margin);
+}
+
+void ImageWidget::moveVertex(const QPoint &p)
+{
+    if (intercept_abs.size() != 4)
+        return;
+    QRect dirty = vertexDirtyRect(vertex_index);
+    intercept_abs[vertex_index] = p;
+    abs2rel();
+    // 旧位置和新位置都需要重绘, 其余瓦片不需要重新绘制
+    update(dirty.united(vertexDirtyRect(vertex_index)));
+}
+
 bool ImageWidget::isOk(const QPoint &p)
 {
     // 超出图片显示范围
-    if (p.x() < h_margin || p.y() < v_margin ||
-        p.x() > h_margin + scaled_pix.width() ||
-        p.y() > v_margin + scaled_pix.height())
-    {
+    if (!imageRect().contains(p))
         return false;
-    }
 
     // 四条边向量
     int v01[2] = { intercept_abs[1].x() - intercept_abs[0].x(),
@@ -276,18 +355,100 @@ QPoint ImageWidget::getNeareastPoint(const QPoint &p)
     }
 }
 
-void ImageWidget::drawImage(QPainter &painter)
+QPointF ImageWidget::relToWidget(const QPointF &p) const
+{
+    QSize size = pyramid.size();
+    return offset + QPointF(p.x() * size.width(), p.y() * size.height()) * zoom;
+}
+
+QPointF ImageWidget::widgetToRel(const QPointF &p) const
 {
-    // 平滑缩放图片
-    scaled_pix = src_pix.scaled(this->width() - 2, this->height() - 2,
-        Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    img_scale = static_cast<double>(scaled_pix.height())
-        / static_cast<double>(src_pix.height());
-    h_margin = scaled_pix.width() < this->width() ?
-        (this->width() - scaled_pix.width()) / 2 : 1;
-    v_margin = scaled_pix.height() < this->height() ?
-        (this->height() - scaled_pix.height()) / 2 : 1;
-    painter.drawPixmap(h_margin, v_margin, scaled_pix);
+    QSize size = pyramid.size();
+    QPointF q = (p - offset) / zoom;
+    return QPointF(q.x() / size.width(), q.y() / size.height());
+}
+
+QRectF ImageWidget::imageRect() const
+{
+    return QRectF(offset, QSizeF(pyramid.size()) * zoom);
+}
+
+double ImageWidget::fitZoom() const
+{
+    QSize size = pyramid.size();
+    if (size.isEmpty())
+        return 1.0;
+    return std::min(static_cast<double>(this->width() - 2) / size.width(),
+        static_cast<double>(this->height() - 2) / size.height());
+}
+
+void ImageWidget::fitToWindow()
+{
+    fit_mode = true;
+    zoom = fitZoom();
+    clampOffset();
+}
+
+void ImageWidget::zoomAt(const QPointF &anchor, double new_zoom)
+{
+    double min_zoom = std::min(fitZoom(), 1.0);
+    new_zoom = std::min(std::max(new_zoom, min_zoom), MAX_ZOOM);
+    // 保持 anchor 处的图片坐标不变
+    QPointF q = (anchor - offset) / zoom;
+    zoom = new_zoom;
+    offset = anchor - q * zoom;
+    fit_mode = std::abs(zoom - fitZoom()) < 1e-6;
+    clampOffset();
+}
+
+void ImageWidget::clampOffset()
+{
+    QSizeF shown = QSizeF(pyramid.size()) * zoom;
+    if (shown.width() <= this->width())
+        offset.setX((this->width() - shown.width()) / 2);
+    else
+        offset.setX(std::min(0.0, std::max(offset.x(), this->width() - shown.width())));
+    if (shown.height() <= this->height())
+        offset.setY((this->height() - shown.height()) / 2);
+    else
+        offset.setY(std::min(0.0, std::max(offset.y(), this->height() - shown.height())));
+}
+
+void ImageWidget::drawImage(QPainter &painter, const QRect &dirty)
+{
+    QRectF visible = QRectF(dirty) & imageRect();
+    if (visible.isEmpty())
+        return;
+
+    // 选择分辨率不低于显示需要的层, 只绘制与 dirty 相交的瓦片
+    const int level = pyramid.levelFor(zoom);
+    const QSize size = pyramid.size();
+    const QSize level_size = pyramid.levelSize(level);
+    const double sx = static_cast<double>(level_size.width()) / size.width();
+    const double sy = static_cast<double>(level_size.height()) / size.height();
+    const int tile = ImagePyramid::TILE_SIZE;
+
+    QPointF tl = (visible.topLeft() - offset) / zoom;
+    QPointF br = (visible.bottomRight() - offset) / zoom;
+    int tx0 = std::max(0, static_cast<int>(tl.x() * sx) / tile);
+    int ty0 = std::max(0, static_cast<int>(tl.y() * sy) / tile);
+    int tx1 = std::min((level_size.width() - 1) / tile, static_cast<int>(br.x() * sx) / tile);
+    int ty1 = std::min((level_size.height() - 1) / tile, static_cast<int>(br.y() * sy) / tile);
+
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, zoom < 1.0);
+    for (int ty = ty0; ty <= ty1; ++ty)
+    {
+        for (int tx = tx0; tx <= tx1; ++tx)
+        {
+            QPixmap pix = pyramid.tile(level, tx, ty);
+            if (pix.isNull())
+                continue;
+            // 瓦片在原图中的范围
+            QRectF src(tx * tile / sx, ty * tile / sy, pix.width() / sx, pix.height() / sy);
+            QRectF target(offset + src.topLeft() * zoom, src.size() * zoom);
+            painter.drawPixmap(target, pix, QRectF(pix.rect()));
+        }
+    }
 }
 
 void ImageWidget::setInterceptBox(const std::vector<std::vector<double>> &points)
@@ -344,9 +505,7 @@ void ImageWidget::drawSelectedRect(QPainter &painter)
     for (const auto &p : selected_rect)
     {
         // 补偿2个像素的精度损失
-        int _x = h_margin + p.x() * scaled_pix.width() + 2;
-        int _y = v_margin + p.y() * scaled_pix.height() + 2;
-        points.append(QPoint(_x, _y));
+        points.append(relToWidget(p).toPoint() + QPoint(2, 2));
     }
 
     painter.setRenderHints(QPainter::Antialiasing, true);
@@ -0,0 +1,143 @@
+﻿#include <algorithm>
+
+#include "include/job_queue.h"
+#include "include/helper.h"
+#include "include/trace.h"
+
+void JobContext::progress(const QString &stage, int done, int total)
+{
+    JobProgress p;
+    p.stage = stage;
+    p.done = done;
+    p.total = total;
+    emit queue_->jobProgress(id_, p);
+}
+
+ProgressCallback JobContext::callback()
+{
+    return [this](const char *stage, int done, int total) {
+        progress(QString::fromUtf8(stage), done, total);
+    };
+}
+
+JobQueue::JobQueue(QObject *parent, int workers) : QObject(parent)
+{
+    qRegisterMetaType<JobProgress>("JobProgress");
+    for (int i = 0; i < std::max(workers, 1); ++i)
+        workers_.emplace_back([this]() { run(); });
+}
+
+JobQueue::~JobQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        quit_ = true;
+        for (auto &[id, token] : running_)
+            token.requestStop();
+        for (auto &job : jobs_)
+            job.token.requestStop();
+    }
+    cv_.notify_all();
+    for (auto &worker : workers_)
+        worker.join();
+}
+
+int JobQueue::submit(const QString &name, Work work, Done done)
+{
+    int id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = next_id_++;
+        jobs_.push_back(Job{ id, name, std::move(work), std::move(done), StopToken::create() });
+    }
+    printLog(QString::fromUtf8(u8"任务%1排队: %2").arg(id).arg(name));
+    emit jobQueued(id, name);
+    cv_.notify_one();
+    return id;
+}
+
+void JobQueue::cancel(int id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = running_.find(id);
+    if (it != running_.end())
+    {
+        it->second.requestStop();
+        return;
+    }
+    // 排队中的任务不移出队列, 轮到时直接以取消结束, 保证完成回调一定执行
+    for (auto &job : jobs_)
+    {
+        if (job.id == id)
+            job.token.requestStop();
+    }
+}
+
+void JobQueue::cancelAll()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &[id, token] : running_)
+        token.requestStop();
+    for (auto &job : jobs_)
+        job.token.requestStop();
+}
+
+int JobQueue::pendingCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<int>(jobs_.size() + running_.size());
+}
+
+void JobQueue::run()
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return quit_ || !jobs_.empty(); });
+            if (quit_)
+                return;
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+            running_.emplace(job.id, job.token);
+        }
+
+        bool cancelled = job.token.stopRequested();
+        if (!cancelled)
+        {
+            printLog(QString::fromUtf8(u8"任务%1开始: %2").arg(job.id).arg(job.name));
+            emit jobStarted(job.id, job.name);
+            JobContext context(this, job.id, job.token);
+            try
+            {
+                TRACE_SCOPE("job", job.id);
+                job.work(context);
+            }
+            catch (const std::exception &e)
+            {
+                printLog(QString::fromUtf8(u8"任务%1异常: %2").arg(job.id).arg(e.what()));
+            }
+            cancelled = job.token.stopRequested();
+        }
+        printLog(QString::fromUtf8(cancelled ? u8"任务%1已取消" : u8"任务%1结束").arg(job.id));
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_.erase(job.id);
+        }
+        finish(job, cancelled);
+    }
+}
+
+void JobQueue::finish(Job &job, bool cancelled)
+{
+    // 队列析构后不再执行
+    QMetaObject::invokeMethod(this,
+        [this, id = job.id, name = job.name, done = std::move(job.done), cancelled]() {
+            if (done)
+                done(cancelled);
+            emit jobFinished(id, name, cancelled);
+        },
+        Qt::QueuedConnection);
+}
@@ -0,0 +1,294 @@
+﻿#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+#include "include/layout_template.h"
+#include "include/helper.h"
+
+namespace
+{
+
+// 线签名的平均差异低于表格尺寸的1%时认为是同一模板
+constexpr double MAX_SIGNATURE_DIFF = 0.01;
+// 单应矩阵 RANSAC 的重投影误差阈值, 像素
+constexpr double RANSAC_THRESHOLD = 5.0;
+
+/*
+* 计算格点矩阵的线签名: 每条竖线取各格点x坐标的平均值, 每条横线取y坐标的平均值,
+* 再按首尾两条线归一化到[0, 1], 与图片的缩放和平移无关
+*/
+void lineSignature(const std::vector<std::vector<cv::Point>> &grid,
+    std::vector<double> &cols, std::vector<double> &rows)
+{
+    cols.clear();
+    rows.clear();
+    if (grid.size() < 2 || grid[0].size() < 2)
+        return;
+
+    const size_t nr = grid.size();
+    const size_t nc = grid[0].size();
+    cols.assign(nc, 0);
+    rows.assign(nr, 0);
+    for (size_t i = 0; i < nr; ++i)
+    {
+        for (size_t j = 0; j < nc; ++j)
+        {
+            cols[j] += grid[i][j].x;
+            rows[i] += grid[i][j].y;
+        }
+    }
+    auto normalize = [](std::vector<double> &sig) {
+        double first = sig.front();
+        double span = sig.back() - first;
+        for (auto &v : sig)
+            v = span > 0 ? (v - first) / span : 0;
+    };
+    normalize(cols);
+    normalize(rows);
+}
+
+// 两个签名的平均差异, 线数量不同时返回无穷大
+double signatureDiff(const std::vector<double> &a, const std::vector<double> &b)
+{
+    if (a.size() != b.size() || a.empty())
+        return HUGE_VAL;
+    double sum = 0;
+    for (size_t i = 0; i < a.size(); ++i)
+        sum += std::abs(a[i] - b[i]);
+    return sum / a.size();
+}
+
+std::vector<cv::Point2f> flatten(const std::vector<std::vector<cv::Point>> &grid)
+{
+    std::vector<cv::Point2f> pts;
+    for (const auto &row : grid)
+        for (const auto &p : row)
+            pts.emplace_back(static_cast<float>(p.x), static_cast<float>(p.y));
+    return pts;
+}
+
+json gridToJson(const std::vector<std::vector<cv::Point>> &grid)
+{
+    json data = json::array();
+    for (const auto &row : grid)
+    {
+        json line = json::array();
+        for (const auto &p : row)
+            line.push_back({ p.x, p.y });
+        data.push_back(line);
+    }
+    return data;
+}
+
+std::vector<std::vector<cv::Point>> gridFromJson(const json &data)
+{
+    std::vector<std::vector<cv::Point>> grid;
+    for (const auto &line : data)
+    {
+        std::vector<cv::Point> row;
+        for (const auto &p : line)
+            row.emplace_back(p.at(0).get<int>(), p.at(1).get<int>());
+        grid.push_back(std::move(row));
+    }
+    return grid;
+}
+
+// 模板名中不能作为文件名的字符替换为下划线
+QString templateFileName(const std::string &name)
+{
+    QString file = QString::fromUtf8(name.c_str());
+    for (QChar ch : QString("\\/:*?\"<>|"))
+        file.replace(ch, '_');
+    return file + ".json";
+}
+
+}  // namespace
+
+bool makeLayoutTemplate(const cv::Mat &img, const TableModel &result,
+    const std::vector<std::vector<int>> &score_rects, const std::string &name, LayoutTemplate &tpl)
+{
+    TableLines lines;
+    if (!recognizeTable(img, lines))
+        return false;
+
+    tpl.name = name;
+    tpl.grid = std::move(lines.points);
+    lineSignature(tpl.grid, tpl.col_signature, tpl.row_signature);
+    tpl.cells = result;
+    tpl.score_columns.clear();
+    for (const auto &rc : score_rects)
+        tpl.score_columns.push_back(rc[0]);
+
+    // 第一个分数格子以下的分数、姓名、学号等每张表都不同, 只保留表头文本
+    int header_bottom = INT_MAX;
+    for (const auto &rc : score_rects)
+        header_bottom = std::min(header_bottom, rc[3]);
+    tpl.score_row = tpl.cells.rowCount();
+    for (int i = 0; i < tpl.cells.size(); ++i)
+    {
+        const CellRect &cell = tpl.cells.rect(i);
+        if ((cell.top + cell.bottom) / 2 < header_bottom)
+            continue;
+        tpl.cells.setText(i, std::string());
+        tpl.score_row = std::min(tpl.score_row, tpl.cells.row(i));
+    }
+    return true;
+}
+
+int TemplateRegistry::load(const QString &dir)
+{
+    std::vector<LayoutTemplate> templates;
+    QDir d(dir);
+    for (const QFileInfo &info : d.entryInfoList(QStringList() << "*.json", QDir::Files, QDir::Name))
+    {
+        QFile file(info.absoluteFilePath());
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+        try
+        {
+            json data = json::parse(file.readAll().toStdString());
+            LayoutTemplate tpl;
+            tpl.name = data.at("name").get<std::string>();
+            tpl.grid = gridFromJson(data.at("grid"));
+            tpl.score_columns = data.at("score_columns").get<std::vector<int>>();
+            tpl.score_row = data.value("score_row", 0);
+            tpl.cells = TableModel::fromJson(data.at("cells"));
+            // 早期保存的模板含有第一张表的姓名等内容, 且无法区分表头, 不使用其中的文本
+            if (!data.contains("score_row"))
+            {
+                for (int i = 0; i < tpl.cells.size(); ++i)
+                    tpl.cells.setText(i, std::string());
+                printLog(QString::fromUtf8(u8"模板%1缺少表头信息, 忽略其中的文本").arg(info.fileName()));
+            }
+            lineSignature(tpl.grid, tpl.col_signature, tpl.row_signature);
+            if (tpl.col_signature.empty())
+                continue;
+            templates.push_back(std::move(tpl));
+        }
+        catch (const std::exception &e)
+        {
+            printLog(QString::fromUtf8(u8"读取模板失败: %1, %2").arg(info.fileName()).arg(e.what()));
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    templates_ = std::move(templates);
+    printLog(QString::fromUtf8(u8"共读取%1个版式模板").arg(templates_.size()));
+    return static_cast<int>(templates_.size());
+}
+
+bool TemplateRegistry::add(LayoutTemplate tpl, const QString &dir)
+{
+    QDir d;
+    if (!d.exists(dir))
+        d.mkpath(dir);
+
+    json data = {
+        {"version", 1},
+        {"name", tpl.name},
+        {"grid", gridToJson(tpl.grid)},
+        {"score_columns", tpl.score_columns},
+        {"score_row", tpl.score_row},
+        {"cells", tpl.cells.toJson()}
+    };
+    QFile file(QDir(dir).filePath(templateFileName(tpl.name)));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        printLog(QString::fromUtf8(u8"无法写入模板文件: %1").arg(file.fileName()));
+        return false;
+    }
+    std::string content = data.dump(2);
+    file.write(content.data(), static_cast<qint64>(content.size()));
+    file.close();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = std::find_if(templates_.begin(), templates_.end(),
+        [&](const LayoutTemplate &t) { return t.name == tpl.name; });
+    if (it != templates_.end())
+        *it = std::move(tpl);
+    else
+        templates_.push_back(std::move(tpl));
+    return true;
+}
+
+bool TemplateRegistry::empty() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return templates_.empty();
+}
+
+bool TemplateRegistry::match(const cv::Mat &img, TableModel &model, std::vector<int> &score_columns,
+    int &score_row, std::string *name) const
+{
+    // 没有模板时不做表格线检测
+    if (empty())
+        return false;
+
+    TableLines lines;
+    if (!recognizeTable(img, lines))
+        return false;
+    std::vector<double> cols;
+    std::vector<double> rows;
+    lineSignature(lines.points, cols, rows);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    const LayoutTemplate *best = nullptr;
+    double best_diff = MAX_SIGNATURE_DIFF;
+    for (const auto &tpl : templates_)
+    {
+        double diff = std::max(signatureDiff(tpl.col_signature, cols), signatureDiff(tpl.row_signature, rows));
+        if (diff < best_diff)
+        {
+            best = &tpl;
+            best_diff = diff;
+        }
+    }
+    if (!best)
+    {
+        printLog(QString::fromUtf8(u8"未匹配到版式模板: %1行 %2列")
+            .arg(static_cast<int>(rows.size()) - 1).arg(static_cast<int>(cols.size()) - 1));
+        return false;
+    }
+
+    // 格点一一对应, RANSAC 剔除个别检测偏差较大的格点
+    cv::Mat homography = cv::findHomography(flatten(best->grid), flatten(lines.points),
+        cv::RANSAC, RANSAC_THRESHOLD);
+    if (homography.empty())
+    {
+        printLog(QString::fromUtf8(u8"模板%1配准失败").arg(QString::fromUtf8(best->name.c_str())));
+        return false;
+    }
+
+    const TableModel &cells = best->cells;
+    std::vector<cv::Point2f> corners;
+    corners.reserve(static_cast<size_t>(cells.size()) * 4);
+    for (int i = 0; i < cells.size(); ++i)
+        for (const auto &p : cells.polygon(i))
+            corners.emplace_back(static_cast<float>(p.x), static_cast<float>(p.y));
+    std::vector<cv::Point2f> mapped;
+    cv::perspectiveTransform(corners, mapped, homography);
+
+    model.clear();
+    for (int i = 0; i < cells.size(); ++i)
+    {
+        TableModel::Polygon polygon;
+        for (size_t k = 0; k < polygon.size(); ++k)
+            polygon[k] = cv::Point(cvRound(mapped[4 * i + k].x), cvRound(mapped[4 * i + k].y));
+        model.addCell(cells.row(i), cells.col(i), cells.rowSpan(i), cells.colSpan(i),
+            std::string(cells.text(i)), polygon);
+    }
+    score_columns = best->score_columns;
+    score_row = best->score_row;
+    if (name)
+        *name = best->name;
+    printLog(QString::fromUtf8(u8"匹配到版式模板%1, 签名差异%2")
+        .arg(QString::fromUtf8(best->name.c_str())).arg(best_diff, 0, 'f', 4));
+    return true;
+}
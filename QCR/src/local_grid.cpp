@@ -0,0 +1,206 @@
+﻿#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <numeric>
+
+#include "include/local_grid.h"
+#include "include/helper.h"
+
+namespace
+{
+
+/*
+* 沿线段 a-b 采样, 返回在 mask 中线段两侧 tol 像素内有前景的采样点比例.
+* 只取中间 60%, 避免交点处另一方向的线条干扰
+*/
+double lineCoverage(const cv::Mat &mask, cv::Point a, cv::Point b, bool horizontal, int tol = 3)
+{
+    const int n = std::max(1, static_cast<int>(cv::norm(b - a)));
+    int hit = 0;
+    int total = 0;
+    for (int s = n / 5; s <= n - n / 5; ++s)
+    {
+        double t = static_cast<double>(s) / n;
+        int x = cvRound(a.x + (b.x - a.x) * t);
+        int y = cvRound(a.y + (b.y - a.y) * t);
+        bool on = false;
+        for (int d = -tol; d <= tol && !on; ++d)
+        {
+            int xx = horizontal ? x : x + d;
+            int yy = horizontal ? y + d : y;
+            if (xx >= 0 && yy >= 0 && xx < mask.cols && yy < mask.rows)
+                on = mask.at<uchar>(yy, xx) != 0;
+        }
+        hit += on;
+        ++total;
+    }
+    return total > 0 ? static_cast<double>(hit) / total : 0;
+}
+
+int findRoot(std::vector<int> &parent, int i)
+{
+    while (parent[i] != i)
+        i = parent[i] = parent[parent[i]];
+    return i;
+}
+
+enum CellKind
+{
+    CELL_EMPTY,
+    CELL_DIGITS,
+    CELL_OTHER,
+};
+
+/*
+* 根据笔画的连通域判断格子内容: 分数最多3位, 每个数字是一个连通域且
+* 细长(宽不超过高的0.85倍), 高度相近; 汉字的连通域数量多或接近方形
+*/
+CellKind classifyCell(const cv::Mat &ink, const cv::Rect &cell)
+{
+    // 向内收缩, 去掉残留的表格线
+    cv::Rect roi(cell.x + 4, cell.y + 4, cell.width - 8, cell.height - 8);
+    roi &= cv::Rect(0, 0, ink.cols, ink.rows);
+    if (roi.width < 5 || roi.height < 5)
+        return CELL_EMPTY;
+
+    cv::Mat labels, stats, centroids;
+    int n = cv::connectedComponentsWithStats(ink(roi), labels, stats, centroids, 8, CV_32S);
+    std::vector<cv::Rect> strokes;
+    for (int i = 1; i < n; ++i)
+    {
+        int h = stats.at<int>(i, cv::CC_STAT_HEIGHT);
+        if (stats.at<int>(i, cv::CC_STAT_AREA) < 10 || h < roi.height / 5)
+            continue;
+        strokes.push_back(cv::Rect(stats.at<int>(i, cv::CC_STAT_LEFT), stats.at<int>(i, cv::CC_STAT_TOP),
+            stats.at<int>(i, cv::CC_STAT_WIDTH), h));
+    }
+    if (strokes.empty())
+        return CELL_EMPTY;
+    if (strokes.size() > 3)
+        return CELL_OTHER;
+
+    int max_h = 0;
+    int min_h = roi.height;
+    for (const auto &rc : strokes)
+    {
+        if (rc.width > 0.85 * rc.height)
+            return CELL_OTHER;
+        max_h = std::max(max_h, rc.height);
+        min_h = std::min(min_h, rc.height);
+    }
+    return min_h >= 0.7 * max_h ? CELL_DIGITS : CELL_OTHER;
+}
+
+}  // namespace
+
+bool detectTableGrid(const cv::Mat &img, TableModel &model, std::vector<int> *digit_columns, int *score_row)
+{
+    model.clear();
+    if (digit_columns)
+        digit_columns->clear();
+    if (score_row)
+        *score_row = 0;
+
+    TableLines lines;
+    if (!recognizeTable(img, lines))
+        return false;
+    const auto &pts = lines.points;
+    const int rows = static_cast<int>(pts.size()) - 1;     // 格子行数
+    const int cols = static_cast<int>(pts[0].size()) - 1;  // 格子列数
+    if (rows < 1 || cols < 1)
+        return false;
+
+    // 相邻格子之间没有表格线时合并, 并查集的下标为 r * cols + c
+    std::vector<int> parent(rows * cols);
+    std::iota(parent.begin(), parent.end(), 0);
+    auto unite = [&](int a, int b) { parent[findRoot(parent, a)] = findRoot(parent, b); };
+    for (int r = 0; r < rows; ++r)
+    {
+        for (int c = 0; c < cols; ++c)
+        {
+            if (c + 1 < cols && lineCoverage(lines.mask_v, pts[r][c + 1], pts[r + 1][c + 1], false) < 0.5)
+                unite(r * cols + c, r * cols + c + 1);
+            if (r + 1 < rows && lineCoverage(lines.mask_h, pts[r + 1][c], pts[r + 1][c + 1], true) < 0.5)
+                unite(r * cols + c, (r + 1) * cols + c);
+        }
+    }
+
+    // 每个合并区域的格子范围
+    struct Region
+    {
+        int r0, c0, r1, c1, count;
+    };
+    std::vector<Region> regions(rows * cols, { rows, cols, -1, -1, 0 });
+    for (int r = 0; r < rows; ++r)
+    {
+        for (int c = 0; c < cols; ++c)
+        {
+            Region &rg = regions[findRoot(parent, r * cols + c)];
+            rg.r0 = std::min(rg.r0, r);
+            rg.c0 = std::min(rg.c0, c);
+            rg.r1 = std::max(rg.r1, r);
+            rg.c1 = std::max(rg.c1, c);
+            ++rg.count;
+        }
+    }
+
+    auto addCell = [&](int r0, int c0, int r1, int c1) {
+        TableModel::Polygon polygon = { pts[r0][c0], pts[r0][c1 + 1], pts[r1 + 1][c1 + 1], pts[r1 + 1][c0] };
+        model.addCell(r0, c0, r1 - r0 + 1, c1 - c0 + 1, std::string(), polygon);
+    };
+    for (int r = 0; r < rows; ++r)
+    {
+        for (int c = 0; c < cols; ++c)
+        {
+            const Region &rg = regions[findRoot(parent, r * cols + c)];
+            int area = (rg.r1 - rg.r0 + 1) * (rg.c1 - rg.c0 + 1);
+            // 合并区域不是矩形时说明表格线检测有误, 不合并
+            if (area != rg.count)
+                addCell(r, c, r, c);
+            else if (r == rg.r0 && c == rg.c0)
+                addCell(rg.r0, rg.c0, rg.r1, rg.c1);
+        }
+    }
+    printLog(QString::fromUtf8(u8"本地识别表格结构: %1行 %2列, %3个单元格")
+        .arg(rows).arg(cols).arg(model.size()));
+
+    if (!digit_columns)
+        return true;
+
+    // 去除表格线后的笔画
+    cv::Mat grid;
+    cv::bitwise_or(lines.mask_h, lines.mask_v, grid);
+    cv::dilate(grid, grid, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5)));
+    cv::Mat ink = lines.binary & ~grid;
+
+    // 表头没有文本, 分数列范围需从第一个数字格子开始, 否则数字会被写入表头
+    int first_digit_row = rows;
+    for (int c = 0; c < cols; ++c)
+    {
+        int digits = 0;
+        int others = 0;
+        int first = rows;
+        for (int r = 0; r < rows; ++r)
+        {
+            int k = model.find(r, c);
+            if (k == TableModel::npos || model.colSpan(k) > 1)
+                continue;
+            const CellRect &rc = model.rect(k);
+            switch (classifyCell(ink, cv::Rect(rc.left, rc.top, rc.right - rc.left, rc.bottom - rc.top)))
+            {
+            case CELL_DIGITS: ++digits; first = std::min(first, r); break;
+            case CELL_OTHER: ++others; break;
+            default: break;
+            }
+        }
+        // 表头等少量文字允许存在
+        if (digits >= 3 && digits >= 3 * others)
+        {
+            digit_columns->push_back(c);
+            first_digit_row = std::min(first_digit_row, first);
+        }
+    }
+    if (score_row && !digit_columns->empty())
+        *score_row = first_digit_row;
+    return true;
+}
@@ -2,14 +2,32 @@
 #include <QtWidgets/QApplication>
 
 #include "../include/helper.h"
+#include "../include/benchmark.h"
+#include "../include/trace.h"
+#include "../include/metrics.h"
 
 
 int main(int argc, char *argv[])
 {
     initSpdLogger();
+    initTrace();
+    initMetrics();
 
-    QApplication a(argc, argv);
-    QCR w;
-    w.show();
-    return a.exec();
+    // 基准测试模式: QCR.exe --bench <name> [args...]
+    int ret = 0;
+    if (argc > 1 && std::string(argv[1]) == "--bench")
+    {
+        ret = runBenchmark(argc - 2, argv + 2);
+    }
+    else
+    {
+        QApplication a(argc, argv);
+        QCR w;
+        w.show();
+        ret = a.exec();
+    }
+    finishTrace();
+    finishMetrics();
+    closeSpdLogger();
+    return ret;
 }
@@ -0,0 +1,303 @@
+﻿#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+#include "include/metrics.h"
+#include "include/helper.h"
+
+namespace
+{
+
+std::string formatDouble(double v)
+{
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.9g", v);
+    return buf;
+}
+
+// 在已有标签后追加一个标签
+std::string joinLabels(const std::string &labels, const std::string &extra)
+{
+    if (labels.empty())
+        return "{" + extra + "}";
+    return "{" + labels + "," + extra + "}";
+}
+
+// 读取请求头的超时时间, 超时未发完请求头的连接直接关闭
+constexpr int REQUEST_TIMEOUT_SECONDS = 5;
+
+/*
+* 本地 /metrics 服务. 只监听 127.0.0.1, 每个连接读取请求头后返回一次结果并关闭.
+* 所有连接在同一个后台线程中异步处理, 一个连接不发送请求头也不会阻塞其他连接,
+* 停止时 io_.stop() 可以立即结束所有未完成的读写
+*/
+class MetricsServer
+{
+public:
+    bool start(unsigned short port)
+    {
+        try
+        {
+            boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+            acceptor_ = std::make_unique<boost::asio::ip::tcp::acceptor>(io_, endpoint);
+        }
+        catch (const std::exception &e)
+        {
+            printLog(QString::fromUtf8(u8"指标服务启动失败: %1").arg(e.what()));
+            return false;
+        }
+        accept();
+        thread_ = std::thread([this]() { io_.run(); });
+        printLog(QString::fromUtf8(u8"指标服务: http://127.0.0.1:%1/metrics").arg(port));
+        return true;
+    }
+
+    void stop()
+    {
+        if (!thread_.joinable())
+            return;
+        io_.stop();
+        thread_.join();
+    }
+
+private:
+    // 一个连接的状态, 由各异步操作的回调共同持有
+    struct Session : std::enable_shared_from_this<Session>
+    {
+        explicit Session(boost::asio::ip::tcp::socket s)
+            : socket(std::move(s)), timer(socket.get_executor())
+        {
+        }
+
+        void start()
+        {
+            auto self = shared_from_this();
+            timer.expires_after(std::chrono::seconds(REQUEST_TIMEOUT_SECONDS));
+            timer.async_wait([self](const boost::system::error_code &ec) {
+                if (ec != boost::asio::error::operation_aborted)
+                {
+                    boost::system::error_code ignored;
+                    self->socket.close(ignored);
+                }
+            });
+            boost::asio::async_read_until(socket, request, "\r\n\r\n",
+                [self](const boost::system::error_code &ec, size_t) {
+                    self->timer.cancel();
+                    if (!ec)
+                        self->respond();
+                });
+        }
+
+        void respond()
+        {
+            std::istream in(&request);
+            std::string method;
+            std::string target;
+            in >> method >> target;
+
+            std::string body;
+            std::string status;
+            if (method == "GET" && (target == "/metrics" || target.rfind("/metrics?", 0) == 0))
+            {
+                status = "200 OK";
+                body = metrics().render();
+            }
+            else
+            {
+                status = "404 Not Found";
+                body = "not found\n";
+            }
+            response = "HTTP/1.1 " + status + "\r\n"
+                "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                "Connection: close\r\n\r\n" + body;
+            auto self = shared_from_this();
+            boost::asio::async_write(socket, boost::asio::buffer(response),
+                [self](const boost::system::error_code &, size_t) {
+                    boost::system::error_code ignored;
+                    self->socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+                });
+        }
+
+        boost::asio::ip::tcp::socket socket;
+        boost::asio::steady_timer timer;
+        boost::asio::streambuf request;
+        std::string response;
+    };
+
+    void accept()
+    {
+        acceptor_->async_accept([this](const boost::system::error_code &ec, boost::asio::ip::tcp::socket socket) {
+            if (ec)
+                return;
+            std::make_shared<Session>(std::move(socket))->start();
+            accept();
+        });
+    }
+
+    boost::asio::io_context io_;
+    std::unique_ptr<boost::asio::ip::tcp::acceptor> acceptor_;
+    std::thread thread_;
+};
+
+MetricsServer metrics_server;
+std::string metrics_file;
+
+}  // namespace
+
+Histogram::Histogram(std::vector<double> bounds)
+    : bounds_(std::move(bounds)), buckets_(new std::atomic<uint64_t>[bounds_.size() + 1])
+{
+    std::sort(bounds_.begin(), bounds_.end());
+    for (size_t i = 0; i <= bounds_.size(); ++i)
+        buckets_[i].store(0, std::memory_order_relaxed);
+}
+
+void Histogram::observe(double v)
+{
+    size_t i = std::lower_bound(bounds_.begin(), bounds_.end(), v) - bounds_.begin();
+    buckets_[i].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    double sum = sum_.load(std::memory_order_relaxed);
+    while (!sum_.compare_exchange_weak(sum, sum + v, std::memory_order_relaxed))
+        ;
+}
+
+const std::vector<double> &latencyBuckets()
+{
+    static const std::vector<double> buckets = {
+        0.001, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30 };
+    return buckets;
+}
+
+MetricsRegistry::Series &MetricsRegistry::series(const std::string &name, const std::string &help,
+    const std::string &labels, Type type)
+{
+    auto it = families_.find(name);
+    if (it == families_.end())
+        it = families_.emplace(name, Family{ type, help, {} }).first;
+    Family &family = it->second;
+    for (auto &s : family.series)
+    {
+        if (s.labels == labels)
+            return s;
+    }
+    family.series.push_back(Series{ labels, nullptr, nullptr, nullptr });
+    return family.series.back();
+}
+
+Counter &MetricsRegistry::counter(const std::string &name, const std::string &help, const std::string &labels)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Series &s = series(name, help, labels, COUNTER);
+    if (!s.counter)
+        s.counter = std::make_unique<Counter>();
+    return *s.counter;
+}
+
+Gauge &MetricsRegistry::gauge(const std::string &name, const std::string &help, const std::string &labels)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Series &s = series(name, help, labels, GAUGE);
+    if (!s.gauge)
+        s.gauge = std::make_unique<Gauge>();
+    return *s.gauge;
+}
+
+Histogram &MetricsRegistry::histogram(const std::string &name, const std::string &help,
+    const std::string &labels, const std::vector<double> &bounds)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Series &s = series(name, help, labels, HISTOGRAM);
+    if (!s.histogram)
+        s.histogram = std::make_unique<Histogram>(bounds);
+    return *s.histogram;
+}
+
+std::string MetricsRegistry::render() const
+{
+    static const char *type_names[] = { "counter", "gauge", "histogram" };
+    std::ostringstream out;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &[name, family] : families_)
+    {
+        out << "# HELP " << name << " " << family.help << "\n";
+        out << "# TYPE " << name << " " << type_names[family.type] << "\n";
+        for (const auto &s : family.series)
+        {
+            std::string labels = s.labels.empty() ? "" : "{" + s.labels + "}";
+            if (s.counter)
+            {
+                out << name << labels << " " << s.counter->value() << "\n";
+            }
+            else if (s.gauge)
+            {
+                out << name << labels << " " << s.gauge->value() << "\n";
+            }
+            else if (s.histogram)
+            {
+                // 桶的数量按 Prometheus 的约定累计输出
+                const Histogram &h = *s.histogram;
+                uint64_t cumulative = 0;
+                for (size_t i = 0; i < h.bounds().size(); ++i)
+                {
+                    cumulative += h.bucket(i);
+                    out << name << "_bucket" << joinLabels(s.labels, "le=\"" + formatDouble(h.bounds()[i]) + "\"")
+                        << " " << cumulative << "\n";
+                }
+                cumulative += h.bucket(h.bounds().size());
+                out << name << "_bucket" << joinLabels(s.labels, "le=\"+Inf\"") << " " << cumulative << "\n";
+                out << name << "_sum" << labels << " " << formatDouble(h.sum()) << "\n";
+                out << name << "_count" << labels << " " << h.count() << "\n";
+            }
+        }
+    }
+    return out.str();
+}
+
+bool MetricsRegistry::dump(const std::string &path) const
+{
+    std::string text = render();
+    FILE *fp = std::fopen(path.c_str(), "wb");
+    if (!fp)
+        return false;
+    std::fwrite(text.data(), 1, text.size(), fp);
+    return std::fclose(fp) == 0;
+}
+
+MetricsRegistry &metrics()
+{
+    static MetricsRegistry registry;
+    return registry;
+}
+
+Histogram &stageHistogram(const char *stage)
+{
+    return metrics().histogram("qcr_stage_seconds", "Time spent in each processing stage",
+        std::string("stage=\"") + stage + "\"");
+}
+
+void initMetrics()
+{
+    if (const char *file = std::getenv("QCR_METRICS_FILE"))
+        metrics_file = file;
+    if (const char *port = std::getenv("QCR_METRICS_PORT"))
+    {
+        int p = std::atoi(port);
+        if (p > 0 && p < 65536)
+            metrics_server.start(static_cast<unsigned short>(p));
+    }
+}
+
+void finishMetrics()
+{
+    metrics_server.stop();
+    if (!metrics_file.empty() && !metrics().dump(metrics_file))
+        printLog(QString::fromUtf8(u8"无法写入指标文件: %1").arg(metrics_file.c_str()));
+}
@@ -0,0 +1,113 @@
+﻿#include <opencv2/core/hal/intrin.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "include/morphology.h"
+
+namespace
+{
+
+// 两行逐元素求 min(IS_MIN) 或 max, 结果写入 d
+template <bool IS_MIN>
+inline void rowOp(const uchar *a, const uchar *b, uchar *d, int n)
+{
+    int x = 0;
+#if CV_SIMD
+    const int step = cv::v_uint8::nlanes;
+    for (; x <= n - step; x += step)
+    {
+        cv::v_uint8 va = cv::vx_load(a + x);
+        cv::v_uint8 vb = cv::vx_load(b + x);
+        cv::v_store(d + x, IS_MIN ? cv::v_min(va, vb) : cv::v_max(va, vb));
+    }
+#endif
+    for (; x < n; ++x)
+        d[x] = IS_MIN ? std::min(a[x], b[x]) : std::max(a[x], b[x]);
+}
+
+/*
+* 竖向 1×len 结构元素, 逐行处理, 每次对整行做 SIMD 运算.
+* 将输入上下各补齐为中性值(腐蚀为255, 膨胀为0)后按长度 len 分块,
+* g 为块内从上往下的前缀极值, h 为块内从下往上的后缀极值,
+* 则窗口 [y, y+len-1] 的极值为 op(h[y], g[y+len-1]).
+*/
+template <bool IS_MIN>
+void morphLineV(const cv::Mat &src, cv::Mat &dst, int len)
+{
+    const int rows = src.rows;
+    const int cols = src.cols;
+    const int anchor = len / 2;  // 与 OpenCV 默认锚点一致
+    const int n = rows + len - 1;
+
+    std::vector<uchar> neutral(cols, IS_MIN ? 255 : 0);
+    auto padded = [&](int j) -> const uchar * {
+        int y = j - anchor;
+        return (y >= 0 && y < rows) ? src.ptr<uchar>(y) : neutral.data();
+    };
+
+    cv::Mat g(n, cols, CV_8UC1);
+    cv::Mat h(n, cols, CV_8UC1);
+    for (int j = 0; j < n; ++j)
+    {
+        if (j % len == 0)
+            std::memcpy(g.ptr<uchar>(j), padded(j), cols);
+        else
+            rowOp<IS_MIN>(g.ptr<uchar>(j - 1), padded(j), g.ptr<uchar>(j), cols);
+    }
+    for (int j = n - 1; j >= 0; --j)
+    {
+        if ((j + 1) % len == 0 || j == n - 1)
+            std::memcpy(h.ptr<uchar>(j), padded(j), cols);
+        else
+            rowOp<IS_MIN>(h.ptr<uchar>(j + 1), padded(j), h.ptr<uchar>(j), cols);
+    }
+
+    dst.create(rows, cols, CV_8UC1);
+    for (int y = 0; y < rows; ++y)
+        rowOp<IS_MIN>(h.ptr<uchar>(y), g.ptr<uchar>(y + len - 1), dst.ptr<uchar>(y), cols);
+}
+
+template <bool IS_MIN>
+void morphLine(const cv::Mat &src, cv::Mat &dst, int len, bool horizontal, int iterations)
+{
+    CV_Assert(src.type() == CV_8UC1 && len > 0);
+    if (len == 1 || iterations < 1 || src.empty())
+    {
+        src.copyTo(dst);
+        return;
+    }
+
+    // 横向结构元素先转置, 复用按行 SIMD 的竖向实现
+    cv::Mat cur;
+    if (horizontal)
+        cv::transpose(src, cur);
+    else
+        cur = src;
+
+    cv::Mat out;
+    for (int i = 0; i < iterations; ++i)
+    {
+        morphLineV<IS_MIN>(cur, out, len);
+        cur = out;
+        out = cv::Mat();
+    }
+
+    if (horizontal)
+        cv::transpose(cur, dst);
+    else
+        dst = cur;
+}
+
+}  // namespace
+
+void erodeLine(const cv::Mat &src, cv::Mat &dst, int len, bool horizontal, int iterations)
+{
+    morphLine<true>(src, dst, len, horizontal, iterations);
+}
+
+void dilateLine(const cv::Mat &src, cv::Mat &dst, int len, bool horizontal, int iterations)
+{
+    morphLine<false>(src, dst, len, horizontal, iterations);
+}
@@ -0,0 +1,464 @@
+﻿#include <opencv2/imgproc.hpp>
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <string>
+#include <thread>
+
+#include "include/pipeline.h"
+#include "include/helper.h"
+#include "include/digits_classify.h"
+#include "include/morphology.h"
+#include "include/cell_index.h"
+#include "include/cell_text.h"
+#include "include/column_stats.h"
+#include "include/trace.h"
+#include "include/metrics.h"
+
+namespace
+{
+
+// 拼接识别出的同一行的多个数字
+void combineWords(std::vector<std::vector<int>> &words, std::vector<int> &word)
+{
+    if (words.empty())
+        return;
+    // 按left坐标从左到右排序
+    std::sort(words.begin(), words.end(),
+        [=](auto w1, auto w2) { return w1[1] < w2[1]; });
+    // 合并数字
+    int nums = 0;
+    for (auto &w : words)
+        nums = nums * 10 + w[5];
+    // 计算整体的坐标和宽高
+    int l = (*std::min_element(words.begin(), words.end(),
+        [=](auto w1, auto w2) { return w1[1] < w2[1]; }))[1];
+    int r = (*std::max_element(words.begin(), words.end(),
+        [=](auto w1, auto w2) { return w1[2] < w2[2]; }))[2];
+    int t = (*std::min_element(words.begin(), words.end(),
+        [=](auto w1, auto w2) { return w1[3] < w2[3]; }))[3];
+    int b = (*std::max_element(words.begin(), words.end(),
+        [=](auto w1, auto w2) { return w1[4] < w2[4]; }))[4];
+    word = { words[0][0], l, r, t, b, nums };
+    printLog(QString(u8"拼接: %1, %2, %3, %4, %5, %6")
+        .arg(word[0]).arg(word[1]).arg(word[2])
+        .arg(word[3]).arg(word[4]).arg(word[5]));
+}
+
+}  // namespace
+
+cv::Mat warpTable(const cv::Mat &img, const std::vector<std::vector<double>> &points_rel)
+{
+    std::vector<std::vector<int>> points;
+    for (const auto &p : points_rel)
+    {
+        int _x = static_cast<int>(p[0] * img.cols);
+        int _y = static_cast<int>(p[1] * img.rows);
+        points.push_back({ _x, _y });
+    }
+
+    // 选取区域的顶点
+    cv::Point2f pointsf[4];
+    pointsf[0] = cv::Point2f(points[0][0], points[0][1]);
+    pointsf[1] = cv::Point2f(points[1][0], points[1][1]);
+    pointsf[2] = cv::Point2f(points[2][0], points[2][1]);
+    pointsf[3] = cv::Point2f(points[3][0], points[3][1]);
+
+    int width = std::sqrt(std::pow(points[1][0] - points[0][0], 2) + std::pow(points[1][1] - points[0][1], 2));
+    int height = std::sqrt(std::pow(points[3][0] - points[0][0], 2) + std::pow(points[3][1] - points[0][1], 2));
+
+    // 变换后的顶点
+    cv::Point2f pts_std[4];
+    pts_std[0] = cv::Point2f(0., 0.);
+    pts_std[1] = cv::Point2f(width, 0.);
+    pts_std[2] = cv::Point2f(width, height);
+    pts_std[3] = cv::Point2f(0., height);
+
+    // 透视变换
+    cv::Mat M = cv::getPerspectiveTransform(pointsf, pts_std);
+    cv::Mat warped;
+    cv::warpPerspective(img, warped, M, cv::Size(width, height), cv::BORDER_REPLICATE);
+    return warped;
+}
+
+cv::Mat removeTableBorders(const cv::Mat &img)
+{
+    printLog(QString::fromUtf8(u8"开始处理图片去除表格边框"));
+    // 检查是否为灰度图，如果不是，转化为灰度图
+    cv::Mat gray = img.clone();
+    if (gray.channels() == 3)
+        cv::cvtColor(gray, gray, CV_BGR2GRAY);
+
+    // 双边滤波
+    cv::Mat blured;
+    cv::bilateralFilter(gray, blured, 5, 70, 70);
+
+    // 自适应均衡化，提高对比度，裁剪效果更好
+    cv::Mat proc;
+    cv::Ptr<cv::CLAHE> clahe = createCLAHE(1, cv::Size(10, 10));
+    clahe->apply(blured, proc);
+
+    // 阈值化，转化为黑白图片
+    cv::Mat img1;
+    adaptiveThreshold(proc, img1, 255,
+        CV_ADAPTIVE_THRESH_GAUSSIAN_C, cv::THRESH_BINARY_INV, 15, 10);
+
+    // 形态学, 保留较长的横竖线条
+    // 黑底白字, 腐蚀掉白字
+    // 线形结构元素使用 van Herk/Gil-Werman 实现, 耗时与核长度无关
+    cv::Mat mat_h;
+    erodeLine(img1, mat_h, 40, true, 2);
+    dilateLine(mat_h, mat_h, 40, true, 2);
+
+    cv::Mat mat_v;
+    erodeLine(img1, mat_v, 40, false, 2);
+    dilateLine(mat_v, mat_v, 40, false, 2);
+
+    cv::Mat mat_table;
+    bitwise_or(mat_h, mat_v, mat_table);
+    dilate(mat_table, mat_table, cv::Mat());
+
+    mat_table = 255 - mat_table;
+
+    // 灰度化后直接阈值化避免过多的处理丢失细节
+    cv::Mat img2;
+    adaptiveThreshold(gray, img2, 255,
+        CV_ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV, 15, 10);
+
+    cv::Mat no_border;
+    bitwise_and(img2, mat_table, no_border);
+
+    printLog(QString::fromUtf8(u8"表格边框已去除"));
+
+    return no_border;
+}
+
+void getScoreColumns(const TableModel &model, const std::vector<int> &digit_columns,
+    std::vector<std::vector<int>> &rects, int score_row)
+{
+    printLog(QString::fromUtf8(u8"解析表格数据以获取分数列像素范围"));
+    // 分数列各单元格的像素范围, 各列共用
+    ColumnStats column;
+    for (int j = 0; j < model.columnCount(); ++j)
+    {
+        column.clear();
+
+        int cnt_all = 0;
+        int cnt_score = 0;
+        bool is_score_column = false;
+        for (int i = std::max(score_row, 0); i < model.rowCount(); ++i)
+        {
+            int index = model.find(i, j);
+            if (index == TableModel::npos)
+                continue;
+
+            ++cnt_all;
+
+            const CellRect &rect = model.rect(index);
+            column.add(rect);
+
+            std::string_view text = model.text(index);
+            CellTextInfo info = classifyCellText(text);
+
+            // 如果包含"平"、"时"、"成"、"绩"任意一个字，则认为这一行以下为分数区域
+            // 表头为印刷体, 一般都能识别出并匹配到相关字符
+            if (info.has_score_char)
+            {
+                printLog(QString::fromUtf8(u8"匹配到某个字符(平、时、成、绩): %1")
+                    .arg(QString::fromUtf8(text.data(), static_cast<int>(text.size()))));
+                if (info.has_score_word)
+                    is_score_column = true;
+                // 重新开始计数
+                cnt_all = 0;
+                cnt_score = 0;
+                column.clear();
+                column.add(rect.left, rect.bottom, rect.right, rect.bottom); // 不包括该单元格
+            }
+
+            // 文本中包含的类型数量, 范围[0-3], 即[空、中文、英文、数字]
+            int type = info.has_zh + info.has_en + info.has_num;
+            int sz = info.length;
+
+            // 类型不止一种且字符数不超过2两个
+            if (sz <= 2 && type > 1)
+                ++cnt_score;
+            // 只有数字一种类型且字符数不超过两个
+            if (sz <= 2 && type == 1 && info.has_num)
+                ++cnt_score;
+        }
+        // 本地识别没有文本, 直接使用识别出的纯数字列
+        if (!digit_columns.empty())
+            is_score_column = std::find(digit_columns.begin(), digit_columns.end(), j)
+                != digit_columns.end();
+        else if (4 * cnt_score > cnt_all)
+            is_score_column = true;
+        if (is_score_column)
+        {
+            // 剔除right像素值偏离中位数较大的单元格
+            CellRect range = column.inlierRange(ColumnStats::RIGHT);
+            int left = range.left;
+            int right = range.right;
+            int top = range.top;
+            int bottom = range.bottom;
+            rects.push_back({ j, left, right,top,bottom });
+            printLog(QString::fromUtf8(u8"分数列: { %1, %2, %3, %4, %5 }").arg(j).arg(left).arg(right).arg(top).arg(bottom));
+        }
+    }
+
+    if (rects.empty())
+        return;
+    // 从左到右排序
+    std::sort(rects.begin(), rects.end(), [=](auto rc1, auto rc2) { return rc1[1] < rc2[1]; });
+    for (size_t i = rects.size() - 1; i > 0; --i)
+    {
+        // 20个像素作为可接受的误差
+        if (rects[i - 1][2] > rects[i][2] - 20)
+        {
+            rects[i - 1][2] = rects[i][1];
+            printLog(QString::fromUtf8(u8"修正%1列: %2, %3, %4, %5")
+                .arg(rects[i - 1][0]).arg(rects[i - 1][1]).arg(rects[i - 1][2])
+                .arg(rects[i - 1][3]).arg(rects[i - 1][4]));
+        }
+    }
+    size_t j = 1;
+    while (j < rects.size())
+    {
+        if (2 * (rects[j - 1][2] - rects[j][1]) >
+            std::min(rects[j - 1][2] - rects[j - 1][1], rects[j][2] - rects[j][1]))
+        {
+            rects[j - 1][2] = std::max(rects[j - 1][2], rects[j][2]);
+            rects[j - 1][3] = std::min(rects[j - 1][3], rects[j][3]);
+            rects[j - 1][4] = std::max(rects[j - 1][4], rects[j][4]);
+            printLog(QString::fromUtf8(u8"合并%1,%2列: { %3, %4, %5, %6}")
+                .arg(rects[j - 1][0]).arg(rects[j][0])
+                .arg(rects[j - 1][1]).arg(rects[j - 1][2]).arg(rects[j - 1][3]).arg(rects[j - 1][4]));
+            rects.erase(rects.begin() + j);
+            continue;
+        }
+        ++j;
+    }
+    printLog(QString::fromUtf8(u8"分数列获取完成, 共获取到%1个分数列").arg(rects.size()));
+}
+
+void extractWords(const cv::Mat &mat, const std::vector<int> &rect,
+    std::vector<std::vector<int>> &words_col, const DigitParams &params, const StopToken &token)
+{
+    printLog(QString::fromUtf8(u8"开始提取数字并识别"));
+    // 一次连通域标记得到所有候选字符的外接矩形, 无需逐个轮廓做变换
+    cv::Mat labels;
+    cv::Mat stats;
+    cv::Mat centroids;
+    int n = cv::connectedComponentsWithStats(mat, labels, stats, centroids, 8, CV_32S);
+
+    std::vector<int> candidates;
+    std::vector<cv::Rect> boxes;
+    for (int i = 1; i < n; ++i)
+    {
+        cv::Rect rc(stats.at<int>(i, cv::CC_STAT_LEFT), stats.at<int>(i, cv::CC_STAT_TOP),
+            stats.at<int>(i, cv::CC_STAT_WIDTH), stats.at<int>(i, cv::CC_STAT_HEIGHT));
+        // 如果超过宽度超过高度的3/2倍认为不是数字
+        if (rc.height < params.min_height || rc.height > params.max_height ||
+            rc.width < params.min_width || rc.width > params.max_width ||
+            params.aspect_den * rc.width > params.aspect_num * rc.height)
+            continue;
+        candidates.push_back(i);
+        boxes.push_back(rc);
+    }
+
+    // 所有候选字符标准化后直接写入 batch 中各自的位置, 最后一次性识别.
+    // 缓冲区按候选数一次分配, 标准化过程不再分配内存
+    std::vector<float> batch(candidates.size() * DIGIT_PIXELS);
+    cv::Rect bounds(0, 0, mat.cols, mat.rows);
+    for (size_t k = 0; k < candidates.size(); ++k)
+    {
+        if (token.stopRequested())
+            return;
+        // 稍微扩大一点范围, 只保留属于该连通域的像素
+        cv::Rect rc = (boxes[k] - cv::Point(2, 2) + cv::Size(4, 4)) & bounds;
+        cv::Mat word = labels(rc);
+        Shear shear = getShear(word, candidates[k]);
+        stdProcLabel(word, candidates[k], shear, batch.data() + k * DIGIT_PIXELS);
+    }
+    std::vector<int> numbers;
+    {
+        TRACE_SCOPE("predict", static_cast<int>(candidates.size()));
+        numbers = predictBatch(batch.data(), candidates.size());
+    }
+
+    for (size_t k = 0; k < candidates.size(); ++k)
+    {
+        const cv::Rect &rc = boxes[k];
+        words_col.push_back({ rect[0], rect[1] + rc.x, rect[1] + rc.x + rc.width,
+            rect[3] + rc.y, rect[3] + rc.y + rc.height, numbers[k] });
+    }
+    printLog(QString::fromUtf8(u8"提取数字并识别完成"));
+}
+
+void spliceWords(std::vector<std::vector<std::vector<int>>> &words, const DigitParams &params)
+{
+    printLog(QString::fromUtf8(u8"开始拼接同一单元格的数字"));
+    TRACE_SCOPE("spliceWords");
+    STAGE_TIMER("splice");
+    if (words.empty())
+        return;
+    for (int i = 0; i < words.size(); ++i)
+    {
+        if (words[i].empty())
+            continue;
+        std::vector<std::vector<int>> words_col = words[i];
+        // 按top坐标从上到下排序
+        std::sort(words_col.begin(), words_col.end(),
+            [=](auto w1, auto w2) { return w1[3] < w2[3]; });
+
+        std::vector<std::vector<int>> digits = { words_col.front() };
+        size_t j = 0;
+        while (j < words_col.size() - 1)
+        {
+            // height = bottom - top
+            int h_min = std::min(words_col[j][4] - words_col[j][3], words_col[j + 1][4] - words_col[j + 1][3]);
+            int h_inc = words_col[j][4] - words_col[j + 1][3];
+            // 竖直相交高度超过较小高度的1/3则认为是同一行的字符
+            if (params.splice_ratio * h_inc > h_min)
+            {
+                digits.push_back(words_col[j + 1]);
+                words_col.erase(words_col.begin() + j);
+                continue;
+            }
+            else
+            {
+                std::vector<int> cell;
+                combineWords(digits, cell);
+                words_col[j] = cell;
+
+                digits.clear();
+                digits.push_back(words_col[j + 1]);
+            }
+            ++j;
+        }
+        std::vector<int> cell;
+        combineWords(digits, cell);
+        words_col.pop_back();
+        words_col.push_back(cell);
+
+        words[i] = words_col;
+    }
+    printLog(QString::fromUtf8(u8"拼接完成"));
+}
+
+std::vector<int> fuseWords(TableModel &model, const std::vector<std::vector<std::vector<int>>> &words)
+{
+    printLog(QString::fromUtf8(u8"开始融合数据"));
+    TRACE_SCOPE("fusion");
+    STAGE_TIMER("fusion");
+    const CellIndex cell_index(model);
+    std::vector<int> changed;
+    for (const auto &words_col : words)
+    {
+        for (const auto &w : words_col)
+        {
+            // 数字所在的单元格
+            int index = cell_index.locate(w[0], w[3], w[4]);
+            if (index == TableModel::npos)
+                continue;
+
+            std::string_view text = model.text(index);
+            CellTextInfo info = classifyCellText(text);
+            bool has_oth = info.has_zh || info.has_en;
+
+            // 有两个数字, 认为原数据是准确的不需要替换
+            if (info.has_num && text[0] != '0' && !has_oth && info.length == 2)
+                ;
+            // 原数据为"100"不替换
+            else if (text == "100")
+                ;
+            // 否则都替换为识别后的数字
+            else if (w[5] > 0 && w[5] <= 100)
+            {
+                model.setText(index, std::to_string(w[5]));
+                changed.push_back(index);
+            }
+        }
+    }
+    printLog(QString::fromUtf8(u8"数据融合完成"));
+    return changed;
+}
+
+std::vector<int> optimizeTable(const cv::Mat &img, TableModel &model, const std::vector<int> &digit_columns,
+    int score_row, const StopToken &token, const ProgressCallback &progress)
+{
+    printLog(QString::fromUtf8(u8"开始优化数字识别结果"));
+    TRACE_SCOPE("optimize");
+    STAGE_TIMER("optimize");
+    std::vector<std::vector<int>> rects;
+    cv::Mat no_border;
+
+    std::thread t1([&]() {
+        TRACE_SCOPE("removeTableBorders");
+        STAGE_TIMER("remove_borders");
+        no_border = removeTableBorders(img);
+    });
+    std::thread t2([&]() {
+        TRACE_SCOPE("getScoreColumn");
+        STAGE_TIMER("score_columns");
+        getScoreColumns(model, digit_columns, rects, score_row);
+    });
+    t1.join();
+    t2.join();
+    if (token.stopRequested())
+        return {};
+
+    // 预览获取到的范围
+    //cv::Mat preview = img.clone();
+    //for (auto rect : rects)
+    //{
+    //    cv::rectangle(preview, cv::Point(rect[1], rect[3]), cv::Point(rect[2], rect[4]), cv::Scalar(0, 255, 255));
+    //}
+
+    // 每一列的结果写入各自的位置, 线程间无需加锁
+    std::vector<std::vector<std::vector<int>>> words(rects.size());
+    // Launch the pool with four threads.
+    size_t num_threads = rects.size();
+    boost::asio::thread_pool pool(num_threads);
+    printLog(QString::fromUtf8(u8"共%1个分数列, 创建%1个线程的线程池").arg(num_threads));
+    static Gauge &column_tasks = metrics().gauge("qcr_column_tasks_queued", "Score columns waiting for digit extraction");
+    column_tasks.add(static_cast<int64_t>(rects.size()));
+    std::atomic<int> columns_done{ 0 };
+    const int columns_total = static_cast<int>(rects.size());
+    if (progress)
+        progress(u8"提取数字", 0, columns_total);
+    for (size_t i = 0; i < rects.size(); ++i)
+    {
+        boost::asio::post(pool,
+            [&, i]()
+            {
+                TRACE_SCOPE("extractWords", rects[i][0]);
+                STAGE_TIMER("extract_words");
+                column_tasks.add(-1);
+                if (token.stopRequested())
+                    return;
+                const std::vector<int> &rect = rects[i];
+                cv::Rect rc(rect[1], rect[3], rect[2] - rect[1], rect[4] - rect[3]);
+                cv::Mat mat = no_border(rc);
+                // 从切割的图片中提取字符并识别
+                extractWords(mat, rect, words[i], DigitParams(), token);
+                if (progress)
+                    progress(u8"提取数字", ++columns_done, columns_total);
+            });
+    }
+    // Wait for all tasks in the pool to complete.
+    pool.join();
+    if (token.stopRequested())
+    {
+        printLog(QString::fromUtf8(u8"优化已取消"));
+        return {};
+    }
+
+    // 拼接识别到的数字
+    spliceWords(words);
+    // 数据融合
+    std::vector<int> changed = fuseWords(model, words);
+    printLog(QString::fromUtf8(u8"优化完毕"));
+    return changed;
+}
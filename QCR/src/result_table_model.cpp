@@ -0,0 +1,96 @@
+﻿#include <QSize>
+
+#include <algorithm>
+
+#include "include/result_table_model.h"
+
+ResultTableModel::ResultTableModel(TableModel &table, QObject *parent)
+    : QAbstractTableModel(parent), table_(table)
+{
+}
+
+int ResultTableModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : table_.rowCount();
+}
+
+int ResultTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : table_.columnCount();
+}
+
+QVariant ResultTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || (role != Qt::DisplayRole && role != Qt::EditRole))
+        return QVariant();
+    int k = table_.find(index.row(), index.column());
+    if (k == TableModel::npos)
+        return QVariant();
+    std::string_view text = table_.text(k);
+    return QString::fromUtf8(text.data(), static_cast<int>(text.size()));
+}
+
+bool ResultTableModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if (!index.isValid() || role != Qt::EditRole)
+        return false;
+    int k = table_.find(index.row(), index.column());
+    if (k == TableModel::npos)
+        return false;
+    table_.setText(k, value.toString().toStdString());
+    emit dataChanged(index, index, { Qt::DisplayRole, Qt::EditRole });
+    return true;
+}
+
+Qt::ItemFlags ResultTableModel::flags(const QModelIndex &index) const
+{
+    Qt::ItemFlags f = QAbstractTableModel::flags(index);
+    // 只有识别出的单元格可以编辑
+    if (index.isValid() && table_.find(index.row(), index.column()) != TableModel::npos)
+        f |= Qt::ItemIsEditable;
+    return f;
+}
+
+QSize ResultTableModel::span(const QModelIndex &index) const
+{
+    int k = index.isValid() ? table_.find(index.row(), index.column()) : TableModel::npos;
+    if (k == TableModel::npos)
+        return QSize(1, 1);
+    return QSize(table_.colSpan(k), table_.rowSpan(k));
+}
+
+void ResultTableModel::replace(TableModel &&table)
+{
+    beginResetModel();
+    table_ = std::move(table);
+    table_.compact();
+    endResetModel();
+}
+
+void ResultTableModel::cellsChanged(const std::vector<int> &cells)
+{
+    if (cells.empty())
+        return;
+    int top = table_.rowCount();
+    int left = table_.columnCount();
+    int bottom = 0;
+    int right = 0;
+    for (int k : cells)
+    {
+        top = std::min(top, table_.row(k));
+        left = std::min(left, table_.col(k));
+        bottom = std::max(bottom, table_.row(k));
+        right = std::max(right, table_.col(k));
+    }
+    emit dataChanged(index(top, left), index(bottom, right), { Qt::DisplayRole, Qt::EditRole });
+}
+
+void ResultTableModel::applySpans(QTableView *view) const
+{
+    view->clearSpans();
+    for (int k = 0; k < table_.size(); ++k)
+    {
+        if (table_.rowSpan(k) > 1 || table_.colSpan(k) > 1)
+            view->setSpan(table_.row(k), table_.col(k), table_.rowSpan(k), table_.colSpan(k));
+    }
+}
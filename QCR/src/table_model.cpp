@@ -0,0 +1,206 @@
+﻿#include <algorithm>
+
+#include "include/table_model.h"
+
+TableModel::TableModel(const TableModel &other)
+{
+    *this = other;
+}
+
+TableModel &TableModel::operator=(const TableModel &other)
+{
+    if (this == &other)
+        return *this;
+    rows_ = other.rows_;
+    cols_ = other.cols_;
+    row_spans_ = other.row_spans_;
+    col_spans_ = other.col_spans_;
+    text_offsets_ = other.text_offsets_;
+    text_lengths_ = other.text_lengths_;
+    rects_ = other.rects_;
+    polygons_ = other.polygons_;
+    index_ = other.index_;
+    index_rows_ = other.index_rows_;
+    index_stride_ = other.index_stride_;
+    row_count_ = other.row_count_;
+    col_count_ = other.col_count_;
+    // 按单元格顺序重新排列文本
+    text_pool_.clear();
+    text_pool_.reserve(other.text_pool_.size());
+    for (int i = 0; i < size(); ++i)
+    {
+        text_offsets_[i] = static_cast<uint32_t>(text_pool_.size());
+        text_pool_ += other.text(i);
+    }
+    return *this;
+}
+
+void TableModel::clear()
+{
+    rows_.clear();
+    cols_.clear();
+    row_spans_.clear();
+    col_spans_.clear();
+    text_offsets_.clear();
+    text_lengths_.clear();
+    rects_.clear();
+    polygons_.clear();
+    text_pool_.clear();
+    index_.clear();
+    index_rows_ = 0;
+    index_stride_ = 0;
+    row_count_ = 0;
+    col_count_ = 0;
+}
+
+void TableModel::reserveIndex(int rows, int cols)
+{
+    if (rows <= index_rows_ && cols <= index_stride_)
+        return;
+    // 按倍数扩容, 逐个添加单元格时摊还复杂度为 O(1)
+    // 行列分别扩容, 只增加列时不改变行数
+    int new_rows = rows <= index_rows_ ? index_rows_ : std::max(rows, 2 * index_rows_);
+    int new_stride = cols <= index_stride_ ? index_stride_ : std::max(cols, 2 * index_stride_);
+    std::vector<int> index(static_cast<size_t>(new_rows) * new_stride, npos);
+    for (int r = 0; r < index_rows_; ++r)
+    {
+        std::copy(index_.begin() + static_cast<size_t>(r) * index_stride_,
+            index_.begin() + static_cast<size_t>(r + 1) * index_stride_,
+            index.begin() + static_cast<size_t>(r) * new_stride);
+    }
+    index_.swap(index);
+    index_rows_ = new_rows;
+    index_stride_ = new_stride;
+}
+
+int TableModel::addCell(int row, int col, int row_span, int col_span,
+    const std::string &text, const Polygon &polygon)
+{
+    if (row < 0 || col < 0)
+        return npos;
+    row_span = std::max(row_span, 1);
+    col_span = std::max(col_span, 1);
+
+    CellRect rc;
+    rc.left = rc.right = polygon[0].x;
+    rc.top = rc.bottom = polygon[0].y;
+    for (const auto &p : polygon)
+    {
+        rc.left = std::min(rc.left, p.x);
+        rc.right = std::max(rc.right, p.x);
+        rc.top = std::min(rc.top, p.y);
+        rc.bottom = std::max(rc.bottom, p.y);
+    }
+
+    row_count_ = std::max(row_count_, row + row_span);
+    col_count_ = std::max(col_count_, col + col_span);
+    reserveIndex(row + 1, col + 1);
+
+    int &slot = index_[static_cast<size_t>(row) * index_stride_ + col];
+    if (slot != npos)
+    {
+        // 覆盖原单元格
+        int i = slot;
+        row_spans_[i] = row_span;
+        col_spans_[i] = col_span;
+        rects_[i] = rc;
+        polygons_[i] = polygon;
+        setText(i, text);
+        return i;
+    }
+
+    int i = size();
+    rows_.push_back(row);
+    cols_.push_back(col);
+    row_spans_.push_back(row_span);
+    col_spans_.push_back(col_span);
+    text_offsets_.push_back(static_cast<uint32_t>(text_pool_.size()));
+    text_lengths_.push_back(static_cast<uint32_t>(text.size()));
+    text_pool_ += text;
+    rects_.push_back(rc);
+    polygons_.push_back(polygon);
+    slot = i;
+    return i;
+}
+
+int TableModel::find(int row, int col) const
+{
+    if (row < 0 || col < 0 || row >= index_rows_ || col >= index_stride_)
+        return npos;
+    return index_[static_cast<size_t>(row) * index_stride_ + col];
+}
+
+std::string_view TableModel::text(int i) const
+{
+    return std::string_view(text_pool_.data() + text_offsets_[i], text_lengths_[i]);
+}
+
+void TableModel::setText(int i, const std::string &text)
+{
+    // 新文本不长于原文本时原地覆盖, 否则追加到缓冲区末尾
+    if (text.size() <= text_lengths_[i])
+    {
+        std::copy(text.begin(), text.end(), text_pool_.begin() + text_offsets_[i]);
+    }
+    else
+    {
+        text_offsets_[i] = static_cast<uint32_t>(text_pool_.size());
+        text_pool_ += text;
+    }
+    text_lengths_[i] = static_cast<uint32_t>(text.size());
+}
+
+void TableModel::compact()
+{
+    size_t used = 0;
+    for (uint32_t len : text_lengths_)
+        used += len;
+    if (used == text_pool_.size())
+        return;
+    std::string pool;
+    pool.reserve(used);
+    for (int i = 0; i < size(); ++i)
+    {
+        uint32_t offset = static_cast<uint32_t>(pool.size());
+        pool += text(i);
+        text_offsets_[i] = offset;
+    }
+    text_pool_.swap(pool);
+}
+
+TableModel TableModel::fromJson(const json &data)
+{
+    TableModel model;
+    for (auto &[srow, cells] : data.items())
+    {
+        int row = std::stoi(srow);
+        for (auto &[scol, cell] : cells.items())
+        {
+            Polygon polygon;
+            const json &points = cell.at("polygon");
+            for (size_t k = 0; k < polygon.size() && k < points.size(); ++k)
+                polygon[k] = cv::Point(points.at(k).at(0), points.at(k).at(1));
+            model.addCell(row, std::stoi(scol), cell.at("row_span"), cell.at("col_span"),
+                cell.at("text").get<std::string>(), polygon);
+        }
+    }
+    return model;
+}
+
+json TableModel::toJson() const
+{
+    json data = json::object();
+    for (int i = 0; i < size(); ++i)
+    {
+        std::vector<std::vector<int>> points;
+        for (const auto &p : polygons_[i])
+            points.push_back({ p.x, p.y });
+        data[std::to_string(rows_[i])][std::to_string(cols_[i])] = {
+            {"row_span", row_spans_[i]},
+            {"col_span", col_spans_[i]},
+            {"text", std::string(text(i))},
+            {"polygon", points}
+        };
+    }
+    return data;
+}
@@ -0,0 +1,77 @@
+﻿#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+
+#include "include/text_crops.h"
+#include "include/cell_text.h"
+
+cv::Mat maskTextCells(const cv::Mat &img, const TableModel &model, const std::vector<int> &cells,
+    cv::Point &offset)
+{
+    if (cells.empty() || img.empty())
+        return cv::Mat();
+
+    cv::Mat mask(img.size(), CV_8UC1, cv::Scalar(0));
+    cv::Rect bound;
+    for (int i : cells)
+    {
+        const auto &polygon = model.polygon(i);
+        std::vector<cv::Point> pts(polygon.begin(), polygon.end());
+        cv::fillConvexPoly(mask, pts, cv::Scalar(255));
+        const CellRect &rc = model.rect(i);
+        cv::Rect r(rc.left, rc.top, rc.right - rc.left, rc.bottom - rc.top);
+        bound = bound.area() > 0 ? (bound | r) : r;
+    }
+    bound &= cv::Rect(0, 0, img.cols, img.rows);
+    if (bound.area() <= 0)
+        return cv::Mat();
+
+    cv::Mat out(bound.size(), img.type(), cv::Scalar::all(255));
+    img(bound).copyTo(out, mask(bound));
+    offset = bound.tl();
+    return out;
+}
+
+int fillCellText(TableModel &model, const std::vector<int> &cells, std::vector<TextLine> lines,
+    cv::Point offset)
+{
+    // 按从上到下排列, 竖直方向重叠的文本视为同一行, 行内再按从左到右排列
+    std::sort(lines.begin(), lines.end(),
+        [](const TextLine &a, const TextLine &b) { return a.box.y < b.box.y; });
+    for (size_t begin = 0; begin < lines.size();)
+    {
+        size_t end = begin + 1;
+        int bottom = lines[begin].box.br().y;
+        while (end < lines.size() && lines[end].box.y + lines[end].box.height / 2 < bottom)
+            bottom = std::max(bottom, lines[end++].box.br().y);
+        std::sort(lines.begin() + begin, lines.begin() + end,
+            [](const TextLine &a, const TextLine &b) { return a.box.x < b.box.x; });
+        begin = end;
+    }
+
+    std::vector<std::string> texts(cells.size());
+    for (const auto &line : lines)
+    {
+        cv::Point c = offset + cv::Point(line.box.x + line.box.width / 2, line.box.y + line.box.height / 2);
+        for (size_t k = 0; k < cells.size(); ++k)
+        {
+            const CellRect &rc = model.rect(cells[k]);
+            if (c.x >= rc.left && c.x < rc.right && c.y >= rc.top && c.y < rc.bottom)
+            {
+                texts[k] += line.text;
+                break;
+            }
+        }
+    }
+
+    int filled = 0;
+    for (size_t k = 0; k < cells.size(); ++k)
+    {
+        std::string text = cleanCellText(texts[k]);
+        if (text.empty())
+            continue;
+        model.setText(cells[k], text);
+        ++filled;
+    }
+    return filled;
+}
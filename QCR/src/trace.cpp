@@ -0,0 +1,171 @@
+﻿#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "include/trace.h"
+
+std::atomic<bool> trace_enabled{ false };
+
+namespace
+{
+
+// 每个线程最多保留的记录数
+constexpr size_t RING_SIZE = 1 << 14;
+
+struct TraceEvent
+{
+    const char *name;
+    int64_t begin;
+    int64_t end;
+    int arg;
+};
+
+/*
+* 单个线程的环形缓冲区, 只有所属线程写入. head 为已写入的总数,
+* 写完记录后以 release 语义递增, 导出时以 acquire 语义读取
+*/
+struct ThreadBuffer
+{
+    explicit ThreadBuffer(int tid) : tid(tid), events(RING_SIZE) {}
+
+    int tid;
+    std::vector<TraceEvent> events;
+    std::atomic<uint64_t> head{ 0 };
+};
+
+const std::chrono::steady_clock::time_point trace_epoch = std::chrono::steady_clock::now();
+
+// 所有线程的缓冲区, 只有创建或归还缓冲区时加锁
+std::mutex buffers_mutex;
+std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+// 已结束线程的缓冲区, 由之后创建的线程复用, 缓冲区数量不超过同时存在的线程数.
+// 复用时保留原有记录, 导出时与新线程的记录显示为同一个 tid
+std::vector<std::shared_ptr<ThreadBuffer>> free_buffers;
+
+std::string trace_path;
+
+// 线程结束时把缓冲区归还到 free_buffers
+struct LocalBuffer
+{
+    ~LocalBuffer()
+    {
+        if (!buffer)
+            return;
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        free_buffers.push_back(std::move(buffer));
+    }
+
+    std::shared_ptr<ThreadBuffer> buffer;
+};
+
+ThreadBuffer &localBuffer()
+{
+    thread_local LocalBuffer local;
+    if (!local.buffer)
+    {
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        if (!free_buffers.empty())
+        {
+            local.buffer = std::move(free_buffers.back());
+            free_buffers.pop_back();
+        }
+        else
+        {
+            buffers.push_back(std::make_shared<ThreadBuffer>(static_cast<int>(buffers.size()) + 1));
+            local.buffer = buffers.back();
+        }
+    }
+    return *local.buffer;
+}
+
+// 转义 json 字符串, 名称一般为字面量, 只处理必要的字符
+void writeString(FILE *fp, const char *s)
+{
+    std::fputc('"', fp);
+    for (; *s; ++s)
+    {
+        if (*s == '"' || *s == '\\')
+            std::fputc('\\', fp);
+        std::fputc(*s, fp);
+    }
+    std::fputc('"', fp);
+}
+
+}  // namespace
+
+int64_t traceNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - trace_epoch).count();
+}
+
+void traceRecord(const char *name, int64_t begin, int64_t end, int arg)
+{
+    ThreadBuffer &buffer = localBuffer();
+    uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    buffer.events[head % RING_SIZE] = { name, begin, end, arg };
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void setTraceEnabled(bool enabled)
+{
+    trace_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool exportTrace(const std::string &path)
+{
+    std::vector<std::shared_ptr<ThreadBuffer>> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        snapshot = buffers;
+    }
+
+    FILE *fp = std::fopen(path.c_str(), "wb");
+    if (!fp)
+        return false;
+    std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", fp);
+    bool first = true;
+    for (const auto &buffer : snapshot)
+    {
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t begin = head > RING_SIZE ? head - RING_SIZE : 0;
+        for (uint64_t i = begin; i < head; ++i)
+        {
+            const TraceEvent &e = buffer->events[i % RING_SIZE];
+            // 完整事件(ph = X), 时间单位为微秒
+            std::fputs(first ? "\n" : ",\n", fp);
+            first = false;
+            std::fputs("{\"name\":", fp);
+            writeString(fp, e.name);
+            std::fprintf(fp, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                buffer->tid, e.begin / 1000.0, (e.end - e.begin) / 1000.0);
+            if (e.arg >= 0)
+                std::fprintf(fp, ",\"args\":{\"arg\":%d}", e.arg);
+            std::fputc('}', fp);
+        }
+    }
+    std::fputs("\n]}\n", fp);
+    return std::fclose(fp) == 0;
+}
+
+void initTrace()
+{
+    const char *path = std::getenv("QCR_TRACE");
+    if (path && *path)
+    {
+        trace_path = path;
+        setTraceEnabled(true);
+    }
+}
+
+void finishTrace()
+{
+    if (trace_path.empty())
+        return;
+    setTraceEnabled(false);
+    exportTrace(trace_path);
+}
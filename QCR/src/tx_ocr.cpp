@@ -10,6 +10,10 @@
 
 #include "include/helper.h"
 #include "include/tx_ocr.h"
+#include "include/json_sax.h"
+#include "include/cell_text.h"
+#include "include/trace.h"
+#include "include/metrics.h"
 
 using namespace std;
 
@@ -144,16 +148,30 @@ static size_t txGetResponse(void *ptr, size_t sz, size_t nmemb, void *stream)
     return sz * nmemb;
 }
 
-int txFormOcrRequest(std::string &result, const std::string &request_url,
+// curl 进度回调, 请求停止时返回非0以中止传输
+static int txProgress(void *clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+{
+    return static_cast<const StopToken *>(clientp)->stopRequested() ? 1 : 0;
+}
+
+/*
+* 发送签名后的POST请求, action 为接口名, 两个接口只有 X-TC-Action 不同
+*/
+static int txPost(std::string &result, const std::string &request_url, const char *action,
     const std::string &secret_id, const std::string &secret_key,
-    const std::string &base64_image)
+    const std::string &base64_image, const StopToken &token, Histogram &latency, Counter &failures)
 {
     result.clear();
 
     std::string bd_data = "{\"ImageBase64\":\"" + base64_image + "\"}";
     int64_t timestamp = std::time(nullptr);
-    std::string authorization = get_authorization(secret_id, secret_key, timestamp, bd_data);
+    std::string authorization;
+    {
+        TRACE_SCOPE("tx sign");
+        authorization = get_authorization(secret_id, secret_key, timestamp, bd_data);
+    }
 
+    std::string hd_action = std::string("X-TC-Action:") + action;
     std::string hd_timestamp = "X-TC-Timestamp:" + int2str(timestamp);
     std::string hd_authorization = "Authorization:" + authorization;
 
@@ -169,7 +187,7 @@ int txFormOcrRequest(std::string &result, const std::string &request_url,
         // 添加表头信息
         struct curl_slist *headers = NULL;
         headers = curl_slist_append(headers, "Content-Type:application/json");
-        headers = curl_slist_append(headers, "X-TC-Action:RecognizeTableOCR");
+        headers = curl_slist_append(headers, hd_action.data());
         headers = curl_slist_append(headers, "X-TC-Region:ap-beijing");
         headers = curl_slist_append(headers, hd_timestamp.data());
         headers = curl_slist_append(headers, "X-TC-Version:2018-11-19");
@@ -182,13 +200,28 @@ int txFormOcrRequest(std::string &result, const std::string &request_url,
         // 设置回调用于写入收到的数据
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, &result);
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, txGetResponse);
+        // 设置回调用于取消请求
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, txProgress);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, const_cast<StopToken *>(&token));
 
         // 打印详细的调试信息
         //curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
 
-        result_code = curl_easy_perform(curl);
+        {
+            TRACE_SCOPE("tx http");
+            ScopedTimer timer(latency);
+            result_code = curl_easy_perform(curl);
+        }
+        if (result_code == CURLE_ABORTED_BY_CALLBACK)
+        {
+            printLog("[tx] request cancelled");
+            curl_easy_cleanup(curl);
+            return 1;
+        }
         if (result_code != CURLE_OK)
         {
+            failures.inc();
             printLog(QString("[tx] curl_easy_perform() failed: %1")
                 .arg(curl_easy_strerror(result_code)));
             is_success = 1;
@@ -204,3 +237,204 @@ int txFormOcrRequest(std::string &result, const std::string &request_url,
     }
     return is_success;
 }
+
+int txFormOcrRequest(std::string &result, const std::string &request_url,
+    const std::string &secret_id, const std::string &secret_key,
+    const std::string &base64_image, const StopToken &token)
+{
+    static Histogram &latency = metrics().histogram("qcr_ocr_request_seconds",
+        "OCR service request latency", "provider=\"tx\",endpoint=\"table\"");
+    static Counter &failures = metrics().counter("qcr_ocr_request_failures_total",
+        "Failed OCR service requests", "provider=\"tx\",endpoint=\"table\"");
+    return txPost(result, request_url, "RecognizeTableOCR", secret_id, secret_key,
+        base64_image, token, latency, failures);
+}
+
+int txGeneralOcrRequest(std::string &result, const std::string &request_url,
+    const std::string &secret_id, const std::string &secret_key,
+    const std::string &base64_image, const StopToken &token)
+{
+    static Histogram &latency = metrics().histogram("qcr_ocr_request_seconds",
+        "OCR service request latency", "provider=\"tx\",endpoint=\"general\"");
+    static Counter &failures = metrics().counter("qcr_ocr_request_failures_total",
+        "Failed OCR service requests", "provider=\"tx\",endpoint=\"general\"");
+    return txPost(result, request_url, "GeneralBasicOCR", secret_id, secret_key,
+        base64_image, token, latency, failures);
+}
+
+namespace
+{
+
+// Response.TableDetections[].Cells[] 中的单元格依次写入当前表格
+class TxTableSax : public PathSax
+{
+public:
+    TableModel best;         // 单元格最多的表格
+    std::string api_error;   // Response.Error.Message
+
+protected:
+    void onStart(bool array) override
+    {
+        if (!array && match({ "Response", "TableDetections", "[]", "Cells", "[]" }))
+        {
+            cell_ = Cell();
+            n_points_ = 0;
+        }
+        else if (!array && match({ "Response", "TableDetections", "[]" }))
+            table_.clear();
+    }
+
+    void onEnd(bool array) override
+    {
+        if (array)
+            return;
+        if (match({ "Response", "TableDetections", "[]", "Cells", "[]", "Polygon", "[]" }))
+        {
+            if (n_points_ < static_cast<int>(cell_.polygon.size()))
+                cell_.polygon[n_points_++] = point_;
+        }
+        else if (match({ "Response", "TableDetections", "[]", "Cells", "[]" }))
+        {
+            // 最小值作为该格子的左上角单元格坐标
+            table_.addCell(cell_.row_tl, cell_.col_tl, cell_.row_br - cell_.row_tl,
+                cell_.col_br - cell_.col_tl, cleanCellText(cell_.text), cell_.polygon);
+        }
+        else if (match({ "Response", "TableDetections", "[]" }))
+        {
+            if (table_.size() > best.size())
+                std::swap(table_, best);
+        }
+    }
+
+    void onNumber(double val) override
+    {
+        const std::string &key = name();
+        if (match({ "Response", "TableDetections", "[]", "Cells", "[]" }))
+        {
+            int v = static_cast<int>(val);
+            if (key == "RowTl")
+                cell_.row_tl = v;
+            else if (key == "ColTl")
+                cell_.col_tl = v;
+            else if (key == "RowBr")
+                cell_.row_br = v;
+            else if (key == "ColBr")
+                cell_.col_br = v;
+        }
+        else if (match({ "Response", "TableDetections", "[]", "Cells", "[]", "Polygon", "[]" }))
+        {
+            if (key == "X")
+                point_.x = static_cast<int>(val);
+            else if (key == "Y")
+                point_.y = static_cast<int>(val);
+        }
+    }
+
+    void onString(std::string &val) override
+    {
+        if (name() == "Text" && match({ "Response", "TableDetections", "[]", "Cells", "[]" }))
+            cell_.text.swap(val);
+        else if (name() == "Message" && match({ "Response", "Error" }))
+            api_error.swap(val);
+    }
+
+private:
+    struct Cell
+    {
+        int row_tl = 0;
+        int col_tl = 0;
+        int row_br = 0;
+        int col_br = 0;
+        std::string text;
+        TableModel::Polygon polygon;
+    };
+
+    TableModel table_;
+    Cell cell_;
+    cv::Point point_;
+    int n_points_ = 0;
+};
+
+// Response.TextDetections[] 中的文本行
+class TxTextSax : public PathSax
+{
+public:
+    std::vector<TextLine> lines;
+    std::string api_error;   // Response.Error.Message
+
+protected:
+    void onStart(bool array) override
+    {
+        if (!array && match({ "Response", "TextDetections", "[]" }))
+            line_ = TextLine();
+    }
+
+    void onEnd(bool array) override
+    {
+        if (!array && match({ "Response", "TextDetections", "[]" }))
+            lines.push_back(std::move(line_));
+    }
+
+    void onNumber(double val) override
+    {
+        if (!match({ "Response", "TextDetections", "[]", "ItemPolygon" }))
+            return;
+        const std::string &key = name();
+        int v = static_cast<int>(val);
+        if (key == "X")
+            line_.box.x = v;
+        else if (key == "Y")
+            line_.box.y = v;
+        else if (key == "Width")
+            line_.box.width = v;
+        else if (key == "Height")
+            line_.box.height = v;
+    }
+
+    void onString(std::string &val) override
+    {
+        if (name() == "DetectedText" && match({ "Response", "TextDetections", "[]" }))
+            line_.text.swap(val);
+        else if (name() == "Message" && match({ "Response", "Error" }))
+            api_error.swap(val);
+    }
+
+private:
+    TextLine line_;
+};
+
+}  // namespace
+
+bool txParseText(const std::string &str, std::vector<TextLine> &lines, std::string &error)
+{
+    TxTextSax sax;
+    if (!json::sax_parse(str, &sax))
+    {
+        error = sax.error();
+        return false;
+    }
+    if (!sax.api_error.empty())
+    {
+        error = sax.api_error;
+        return false;
+    }
+    lines = std::move(sax.lines);
+    return true;
+}
+
+bool txParseTable(const std::string &str, TableModel &model, std::string &error)
+{
+    TxTableSax sax;
+    if (!json::sax_parse(str, &sax))
+    {
+        error = sax.error();
+        return false;
+    }
+    if (!sax.api_error.empty())
+    {
+        error = sax.api_error;
+        return false;
+    }
+    model = std::move(sax.best);
+    return true;
+}
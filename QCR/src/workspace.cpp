@@ -0,0 +1,176 @@
+﻿#include <QFileInfo>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <cmath>
+
+#include "include/workspace.h"
+#include "include/helper.h"
+#include "include/pipeline.h"
+#include "include/trace.h"
+#include "include/metrics.h"
+
+cv::Mat applySheetOps(const cv::Mat &src, const std::vector<SheetOp> &ops)
+{
+    cv::Mat img = src;
+    for (const auto &op : ops)
+    {
+        if (op.type == SheetOp::ROTATE)
+        {
+            cv::Mat rotated;
+            cv::rotate(img, rotated, cv::ROTATE_90_CLOCKWISE);
+            img = rotated;
+        }
+        else
+        {
+            img = warpTable(img, op.points);
+        }
+    }
+    return img;
+}
+
+cv::Mat loadSheetImage(const QString &path, int len, int sz)
+{
+    TRACE_SCOPE("resizeImage");
+    STAGE_TIMER("resize_image");
+    sz *= 1024 * 1024; // MB to Byte
+    cv::Mat img = cv::imread(path.toLocal8Bit().data());
+    if (img.empty())
+    {
+        printLog(QString::fromUtf8(u8"无法读取图片: %1").arg(path));
+        return img;
+    }
+    double scale = 1.0;
+    // 缩小宽高超过 len 像素的图片以加快处理速度
+    if (img.rows > len || img.cols > len)
+    {
+        double r = static_cast<double>(img.rows);
+        double c = static_cast<double>(img.cols);
+        scale = len / r < len / c ?
+            len / r : len / c;
+    }
+    QFileInfo info(path);
+    if (info.size() > sz)
+    {
+        double _s = std::sqrt(static_cast<double>(sz) / info.size());
+        if (_s < scale)
+            scale = _s;
+    }
+
+    double _sz = info.size() / 1024.0 / 1024.0;
+    QString s_sz = QString::number(_sz, 'f', 2);
+    if (scale < 1.0)
+    {
+        printLog(QString::fromUtf8(u8"图片过大(%1 MB, %2x%3), 按比例 %4 压缩")
+            .arg(s_sz).arg(img.cols).arg(img.rows).arg(scale));
+
+        cv::resize(img, img, cv::Size(), scale, scale, cv::INTER_AREA);
+        cv::imwrite(path.toLocal8Bit().data(), img);
+
+        // 重新获取文件信息
+        info.refresh();
+        _sz = info.size() / 1024.0 / 1024.0;
+        s_sz = QString::number(_sz, 'f', 2);
+        printLog(QString::fromUtf8(u8"图片已压缩至: %1 MB, %2x%3").arg(s_sz).arg(img.cols).arg(img.rows));
+    }
+    else
+    {
+        printLog(QString::fromUtf8(u8"图片无需压缩: %1 MB, %2x%3").arg(s_sz).arg(img.cols).arg(img.rows));
+    }
+    return img;
+}
+
+size_t Sheet::imageBytes() const
+{
+    size_t bytes = src_img.total() * src_img.elemSize();
+    if (cropped_img.data != src_img.data)
+        bytes += cropped_img.total() * cropped_img.elemSize();
+    return bytes;
+}
+
+QString Sheet::name() const
+{
+    QString text = QFileInfo(path).fileName();
+    if (page >= 0)
+        text += QString::fromUtf8(u8" 第%1页").arg(page + 1);
+    return text;
+}
+
+QString Sheet::contourKey() const
+{
+    return QString("%1:%2").arg(id).arg(image_generation);
+}
+
+QString Sheet::displayText() const
+{
+    static const char *names[] = {
+        u8"等待加载", u8"待识别", u8"识别中", u8"已识别", u8"已优化", u8"失败" };
+    QString text = name() + "  " + QString::fromUtf8(names[status]);
+    if (loading)
+        text += QString::fromUtf8(u8" (加载中)");
+    else if (!loaded() && status != PENDING && status != FAILED)
+        text += QString::fromUtf8(u8" (图片已释放)");
+    return text;
+}
+
+Workspace::Workspace(size_t budget_mb) : budget_(budget_mb * 1024 * 1024)
+{
+}
+
+Sheet &Workspace::add(const QString &path)
+{
+    auto sheet = std::make_unique<Sheet>();
+    sheet->id = next_id_++;
+    sheet->path = path;
+    sheets_.push_back(std::move(sheet));
+    return *sheets_.back();
+}
+
+Sheet *Workspace::find(int id)
+{
+    int index = indexOf(id);
+    return index < 0 ? nullptr : sheets_[index].get();
+}
+
+int Workspace::indexOf(int id) const
+{
+    for (size_t i = 0; i < sheets_.size(); ++i)
+    {
+        if (sheets_[i]->id == id)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+size_t Workspace::imageBytes() const
+{
+    size_t bytes = 0;
+    for (const auto &sheet : sheets_)
+        bytes += sheet->imageBytes();
+    return bytes;
+}
+
+std::vector<int> Workspace::evict(int keep)
+{
+    std::vector<int> evicted;
+    size_t bytes = imageBytes();
+    for (auto &sheet : sheets_)
+    {
+        if (bytes <= budget_)
+            break;
+        if (sheet->id == keep || sheet->loading || !sheet->loaded())
+            continue;
+        if (sheet->status != Sheet::RECOGNIZED && sheet->status != Sheet::OPTIMIZED)
+            continue;
+        bytes -= sheet->imageBytes();
+        // 正在执行的任务持有自己的引用, 任务结束后才会真正释放
+        sheet->src_img.release();
+        sheet->cropped_img.release();
+        evicted.push_back(sheet->id);
+    }
+    if (!evicted.empty())
+        printLog(QString::fromUtf8(u8"图片内存超过预算, 释放%1张已识别表格的图片, 剩余%2 MB")
+            .arg(evicted.size()).arg(bytes / 1024.0 / 1024.0, 0, 'f', 1));
+    return evicted;
+}